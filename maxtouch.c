@@ -1,24 +1,139 @@
 #include <cstdint>
 #include <cstdbool>
+#include <cstddef>
+#include <cstring>
+#include <array>
+#include <bit>
+#include <iterator>
+#include <numeric>
 #include "maxtouch.h"
 
-#define DIVIDE_UNSIGNED_ROUND(numerator, denominator) (((numerator) + ((denominator) / 2)) / (denominator))
-#define CPI_TO_SAMPLES(cpi, dist_in_mm) (DIVIDE_UNSIGNED_ROUND((cpi) * (dist_in_mm) * 10, 254))
-#define SAMPLES_TO_CPI(samples, dist_in_mm) (DIVIDE_UNSIGNED_ROUND((samples) * 254, (dist_in_mm) * 10))
+// The feature matrix. Each optional part of the driver has a switch, so a board only spends flash and RAM on the
+// parts it uses:
+//
+//   Decoders     MXT_TOUCH_SUPPRESSION (T42), MXT_CONTACT_ELLIPSE, MXT_CONTACT_PRESSURE, MXT_KEY_ARRAY (T15/T97)
+//   Filters      MXT_LINEARITY_GRID, MXT_JITTER_FILTER, MXT_REPORT_GATE
+//   Gestures     MXT_WAKE_GESTURE (T24/T93)
+//   Diagnostics  MXT_SELFTEST (T25), MXT_NOISE_STATS (T72), MXT_CONFIG_DUMP, MXT_RECALIBRATION, MXT_METRICS,
+//                MXT_JOURNAL
+//   Tracing      MXT_TRACE_LENGTH, MXT_STREAM
+//   Transports   MXT_RAW_HID, MXT_TUNING
+//   Power        MXT_CHG_PIN, MXT_SCAN_PLANNER
+//
+// The default profile turns on the features the driver has always built in. Define MXT_PROFILE_MINIMAL to drop those
+// too, leaving the probe, the configuration write and T100 contacts, and then add back what the board needs. The
+// message handlers and tables of a feature which is off are not compiled at all, tools/size_report.sh breaks a build
+// down by function.
+#ifndef MXT_PROFILE_MINIMAL
+#ifndef MXT_TOUCH_SUPPRESSION
+#define MXT_TOUCH_SUPPRESSION
+#endif
+#ifndef MXT_SELFTEST
+#define MXT_SELFTEST
+#endif
+#ifndef MXT_NOISE_STATS
+#define MXT_NOISE_STATS
+#endif
+#ifndef MXT_CONFIG_DUMP
+#define MXT_CONFIG_DUMP
+#endif
+#ifndef MXT_SCAN_PLANNER
+#define MXT_SCAN_PLANNER
+#endif
+#endif
 
-// By default we assume all available X and Y pins are in use, but a designer
-// may decide to leave some pins unconnected, so the size can be overridden here.
-#ifndef MXT_MATRIX_X_SIZE
-#define MXT_MATRIX_X_SIZE information.matrix_x_size
+// Features other features are built on
+#if defined(MXT_JITTER_FILTER) && !defined(MXT_NOISE_STATS)
+#define MXT_NOISE_STATS // The filter's strength follows the T72 noise state
+#endif
+#if defined(MXT_TRACE_LENGTH) || defined(MXT_RECALIBRATION) || defined(MXT_STREAM) || defined(MXT_TUNING)
+#define MXT_POOL // Their buffers come from the pool
 #endif
-#ifndef MXT_MATRIX_Y_SIZE
-#define MXT_MATRIX_Y_SIZE information.matrix_y_size
+#if defined(MXT_STREAM) && !defined(MXT_RAW_HID)
+#error "MXT_STREAM needs MXT_RAW_HID"
 #endif
+#if defined(MXT_TUNING) && !defined(MXT_RAW_HID)
+#error "MXT_TUNING needs MXT_RAW_HID"
+#endif
+
+#define DIVIDE_UNSIGNED_ROUND(numerator, denominator) (((numerator) + ((denominator) / 2)) / (denominator))
+#define CPI_TO_SAMPLES(cpi, dist_in_01mm) (DIVIDE_UNSIGNED_ROUND((uint32_t)(cpi) * (dist_in_01mm), 254))
+#define SAMPLES_TO_CPI(samples, dist_in_01mm) (DIVIDE_UNSIGNED_ROUND((uint32_t)(samples) * 254, (dist_in_01mm)))
+
+// The sensor design, boards with a different sensor define their own mxt_sensor_geometry and point this at it.
+#ifndef MXT_SENSOR_GEOMETRY
+#define MXT_SENSOR_GEOMETRY PEACOCK_SENSOR_GEOMETRY
+#endif
+static constexpr mxt_sensor_geometry sensor = MXT_SENSOR_GEOMETRY;
+
+static_assert(sensor.x_lines > 0 && sensor.y_lines > 0, "The sensor must use at least one X and one Y line");
+static_assert(sensor.x_pitch() >= MXT_MIN_PITCH && sensor.x_pitch() <= MXT_MAX_PITCH, "X line pitch can't be represented in T100");
+static_assert(sensor.y_pitch() >= MXT_MIN_PITCH && sensor.y_pitch() <= MXT_MAX_PITCH, "Y line pitch can't be represented in T100");
+static_assert((sensor.orientation & ~(T100_CFG_SWITCHXY | T100_CFG_INVERTX | T100_CFG_INVERTY)) == 0,
+              "The sensor orientation may only use the SWITCHXY, INVERTX and INVERTY bits");
+
+// The highest CPI whose range still fits on the longest axis
+static constexpr uint16_t max_cpi = (uint32_t)MXT_MAX_RANGE * 254 / (sensor.width > sensor.height ? sensor.width : sensor.height);
+
 #define MXT_DEFAULT_DPI 600
 #define MXT_TOUCH_THRESHOLD 18
 #define MXT_GAIN 4
 #define MXT_DX_GAIN 255
 #define NUM_FINGERS 5 // Can be up to 10
+static_assert(MXT_DEFAULT_DPI <= max_cpi, "The default CPI is too high for this sensor");
+#ifndef MXT_RESET_TIME_MS
+#define MXT_RESET_TIME_MS 100 // Time from releasing reset until the chip responds on I2C
+#endif
+#define MXT_MAX_OBJECTS 48
+#ifndef MXT_SUPPRESSION_AREA
+#define MXT_SUPPRESSION_AREA 20 // Contacts covering more nodes than this are taken to be a palm and suppressed
+#endif
+
+// A simple model of the time the chip takes to acquire one frame, used to plan the T46 acquisition parameters.
+// The constants are approximations for the mXT336UD, they can be tuned per board against measured scan rates.
+#ifndef MXT_PULSE_TIME_NS
+#define MXT_PULSE_TIME_NS 4000 // One transmit pulse at the default burst frequency
+#endif
+#ifndef MXT_X_LINE_OVERHEAD_NS
+#define MXT_X_LINE_OVERHEAD_NS 20000 // Settling and ADC setup for each X line
+#endif
+#ifndef MXT_NODE_PROCESSING_NS
+#define MXT_NODE_PROCESSING_NS 300 // Signal processing for each node
+#endif
+#ifndef MXT_FRAME_OVERHEAD_US
+#define MXT_FRAME_OVERHEAD_US 500 // Touch processing and message generation
+#endif
+#ifndef MXT_SCAN_BUDGET_PERCENT
+#define MXT_SCAN_BUDGET_PERCENT 80 // Leave headroom for noise suppression to repeat a burst
+#endif
+#ifndef MXT_MAX_TRANSFER_SIZE
+#define MXT_MAX_TRANSFER_SIZE 128 // The largest single read our I2C driver supports
+#endif
+
+// The address the chip answered on when it was probed
+static uint8_t mxt_address = MXT336UD_ADDRESS;
+
+enum {
+    MXT_MODE_NOT_FOUND,
+    MXT_MODE_APPLICATION,
+    MXT_MODE_BOOTLOADER,         // Stuck in the bootloader, but the application is intact
+    MXT_MODE_BOOTLOADER_APP_CRC, // In the bootloader because the application failed its CRC check, it needs reflashing
+};
+
+typedef struct {
+    uint8_t mode;
+    uint8_t address;
+    uint8_t bootloader_status;
+    uint32_t elapsed_ms; // How long the probe, and any recovery, took
+} mxt_probe_result;
+
+// The information block, read once at startup.
+static mxt_information_block information = {};
+
+// The object table, and the checksum of the information block which follows it.
+static mxt_object_table_element object_table[MXT_MAX_OBJECTS] = {};
+static uint8_t num_objects = 0;
+static uint8_t information_crc[3] = {};
 
 // Data from the object table. Registers are not at fixed addresses, they may vary between firmware
 // versions. Instead must read the addresses from the object table.
@@ -28,250 +143,3585 @@ static uint16_t t5_max_message_size = 0;
 static uint16_t t6_command_processor_address = 0;
 static uint16_t t7_powerconfig_address = 0;
 static uint16_t t8_acquisitionconfig_address = 0;
+static uint16_t t15_key_array_address = 0;
+static uint16_t t42_touch_suppression_address = 0;
 static uint16_t t44_message_count_address = 0;
 static uint16_t t46_cte_config_address = 0;
+static uint16_t t24_gesture_address = 0;
+static uint16_t t25_selftest_address = 0;
+static uint16_t t37_diagnostic_address = 0;
+static uint16_t t93_touch_sequence_address = 0;
+static uint16_t t97_ptc_keys_address = 0;
 static uint16_t t100_multiple_touch_touchscreen_address = 0;
 
-// The object table also contains report_ids. These are used to identify which object generated a
-// message. Again we must lookup these values rather than using hard coded values.
-// Most messages are ignored, we basically just want the messages from the t100 object for now.
-static uint16_t t100_first_report_id = 0;
-static uint16_t t100_second_report_id = 0;
-static uint16_t t100_subsequent_report_ids[NUM_FINGERS] = {};
-static uint16_t t100_num_reports = 0;
-
-// Current driver state state
-static uint16_t cpi = MXT_DEFAULT_DPI;
-
 typedef struct {
     bool  confidence;
     bool  tip;
     uint16_t x;
     uint16_t y;
+#ifdef MXT_CONTACT_ELLIPSE
+    uint16_t width;   // Major axis of the contact, in the same units as x and y
+    uint16_t height;  // Minor axis of the contact
+    uint8_t azimuth;  // Angle of the major axis anticlockwise from the X axis, 0-179 degrees
+#endif
+#ifdef MXT_CONTACT_PRESSURE
+    uint16_t pressure; // 0 to MXT_PRESSURE_MAX
+    bool pressed;      // Set once the pressure crosses MXT_PRESS_THRESHOLD, cleared below MXT_RELEASE_THRESHOLD
+#endif
 } finger_t;
 
 typedef struct {
     finger_t fingers[NUM_FINGERS];
+#ifdef MXT_KEY_ARRAY
+    uint32_t keys; // One bit per key, the T15 keys followed by any T97 keys
+#endif
 } digitizer_t;
 
-void read_object_table(void)
-{
-    mxt_information_block information = {0};
+// The object table also contains report_ids. These are used to identify which object generated a
+// message. Again we must lookup these values rather than using hard coded values. Each object we
+// care about registers a handler for its range of report_ids, messages are dispatched by range and
+// the handler is given the index of the report_id within its object.
+typedef void (*message_handler)(const mxt_message &message, uint8_t index, digitizer_t &digitizer);
 
-    ////////////////////////////////////////////////////////////////////////////////////////
-    // First read the start of the information block to find out how many objects we have //
-    ////////////////////////////////////////////////////////////////////////////////////////
-    int status = I2C_Read(MXT336UD_ADDRESS, MXT_REG_INFORMATION_BLOCK, (uint8_t *)&information,
-                          sizeof(mxt_information_block));
-    if (status == OK)
-    {
-        // On Peacock the expected result is device family: 166 with 34 objects
-        printf("Found MXT %d:%d, fw %d.%d with %d objects. Matrix size %dx%d\n", information.family_id, information.variant_id,
-               information.version, information.build, information.num_objects, information.matrix_x_size, information.matrix_y_size);
+typedef struct {
+    uint8_t first_report_id;
+    uint8_t last_report_id;
+    message_handler handler;
+} report_handler;
 
-        /////////////////////////////////////////////////////////////////////////////////////////////
-        // Now read the object table to lookup the addresses and report_ids of the various objects //
-        /////////////////////////////////////////////////////////////////////////////////////////////
-        
-        // We accumulate report_ids as we walk the object table, the first report_id is 1.
-        int report_id = 1;
-        uint16_t object_table_element_address = sizeof(mxt_information_block);
-        for (int i = 0; i < information.num_objects; i++)
-        {
-            // Read the object table entries one at a time, we could read the whole lot in one go.
-            mxt_object_table_element object = {};
-            status = I2C_Read(MXT336UD_ADDRESS, object_table_element_address,
-                              (uint8_t *)&object, sizeof(mxt_object_table_element));
-            if (status == OK)
-            {
-                // Note: the address should be transmitted in network byte order
-                const uint16_t address = (object.position_ms_byte << 8) | object.position_ls_byte;
-                switch (object.type)
-                {
-                case 2:
-                    t2_encryption_status_address = address;
-                    break;
-                case 5:
-                    t5_message_processor_address = address;
-                    t5_max_message_size = object.size_minus_one - 1;
-                    break;
-                case 6:
-                    t6_command_processor_address = address;
-                    break;
-                case 7:
-                    t7_powerconfig_address = address;
-                    break;
-                case 8:
-                    t8_acquisitionconfig_address = address;
-                    break;
-                case 44:
-                    t44_message_count_address = address;
-                    break;
-                case 46:
-                    t46_cte_config_address = address;
-                    break;
-                case 100:
-                    t100_multiple_touch_touchscreen_address = address;
-                    t100_first_report_id = report_id;
-                    t100_second_report_id = report_id + 1;
-                    for (t100_num_reports = 0; t100_num_reports < NUM_FINGERS && t100_num_reports < object.report_ids_per_instance; t100_num_reports++)
-                    {
-                        t100_subsequent_report_ids[t100_num_reports] = report_id + 2 + t100_num_reports;
-                    }
-                    break;
-                }
-                object_table_element_address += sizeof(mxt_object_table_element);
-                report_id += object.report_ids_per_instance * (object.instances_minus_one + 1);
-            }
-            else
-            {
-                printf("Failed to read object table element. Status: %d\n", status);
-            }
-        }
-    }
-    else
-    {
-        printf("Failed to read object table. Status: %d\n", status);
-    }
+// One handler for each object we decode: T6 and T100 always, then the objects of each enabled feature
+static constexpr uint8_t decoded_objects = 2
+#ifdef MXT_SELFTEST
+                                           + 1 // T25
+#endif
+#ifdef MXT_KEY_ARRAY
+                                           + 2 // T15 and T97
+#endif
+#ifdef MXT_TOUCH_SUPPRESSION
+                                           + 1 // T42
+#endif
+#ifdef MXT_NOISE_STATS
+                                           + 1 // T72
+#endif
+#ifdef MXT_WAKE_GESTURE
+                                           + 2 // T24 and T93
+#endif
+    ;
+#ifndef MXT_MAX_REPORT_HANDLERS
+#define MXT_MAX_REPORT_HANDLERS decoded_objects
+#endif
+static_assert(MXT_MAX_REPORT_HANDLERS >= decoded_objects, "Every decoded object needs a report handler");
+static report_handler report_handlers[MXT_MAX_REPORT_HANDLERS] = {};
+static uint8_t num_report_handlers = 0;
+
+static void handle_t6_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer);
+#ifdef MXT_SELFTEST
+static void handle_t25_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer);
+#endif
+#ifdef MXT_KEY_ARRAY
+static void handle_t15_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer);
+static void handle_t97_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer);
+#endif
+#ifdef MXT_TOUCH_SUPPRESSION
+static void handle_t42_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer);
+#endif
+#ifdef MXT_NOISE_STATS
+static void handle_t72_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer);
+#endif
+#ifdef MXT_WAKE_GESTURE
+static void handle_t24_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer);
+static void handle_t93_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer);
+#endif
+static void handle_t100_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer);
+
+// T25 self test state. The tests run in the background after initialize(), see selftest_task().
+#ifdef MXT_SELFTEST
+#ifndef MXT_SELFTEST_TIMEOUT_MS
+#define MXT_SELFTEST_TIMEOUT_MS 1000 // A test which hasn't reported by now, after a chip reset say, counts as failed
+#endif
+
+enum {
+    SELFTEST_IDLE,
+    SELFTEST_PENDING,
+    SELFTEST_RUNNING,
+    SELFTEST_DONE
+};
+
+// A compact summary of every fault reported by the self tests since boot
+typedef struct {
+    uint8_t state;
+    uint8_t failed_tests;     // Number of tests which reported a fault
+    uint8_t last_result;      // The last T25 result code
+    uint64_t x_pin_faults;    // One bit per X line
+    uint64_t y_pin_faults;    // One bit per Y line
+    uint8_t signal_limit_object; // The object type which exceeded its signal limits, 0 if none did
+} selftest_faults_t;
+
+static const uint8_t selftest_sequence[] = {T25_CMD_PIN_FAULT, T25_CMD_SIGNAL_LIMIT};
+static uint8_t selftest_step = 0;
+static uint32_t selftest_start_time = 0;
+static selftest_faults_t selftest_faults = {};
+#endif
+
+// Set while T42 reports that it is suppressing touches, the contacts are marked as unintended until it clears
+#ifdef MXT_TOUCH_SUPPRESSION
+static bool touch_suppressed = false;
+#endif
+
+// T72 noise suppression statistics, the chip hops burst frequency and moves between noise states as the noise changes
+#ifdef MXT_NOISE_STATS
+typedef struct {
+    uint8_t state;          // The current T72_STATE_*, 0 until the first message
+    uint8_t level;          // The last reported noise level
+    uint8_t peak_level;     // The highest noise level reported since boot
+    uint16_t frequency_hops;
+    uint16_t state_changes;
+    uint32_t noisy_ms;      // Time spent in the noisy and very noisy states, up to the last state change
+    uint32_t state_time;    // When the current state was entered
+} noise_stats_t;
+
+static noise_stats_t noise_stats = {};
+#endif
+
+// A software filter for the jitter which gets through the chip's filters in noisy conditions. Its strength follows the
+// T72 noise state, so a stable sensor pays no latency for it. Define MXT_JITTER_FILTER to enable it.
+#ifdef MXT_JITTER_FILTER
+#ifndef MXT_JITTER_NOISY_WEIGHT
+#define MXT_JITTER_NOISY_WEIGHT 160 // Weight of the previous position in Q8 while noisy
+#endif
+#ifndef MXT_JITTER_VERY_NOISY_WEIGHT
+#define MXT_JITTER_VERY_NOISY_WEIGHT 208 // Weight of the previous position in Q8 while very noisy
+#endif
+#ifndef MXT_JITTER_SNAP_DISTANCE
+#define MXT_JITTER_SNAP_DISTANCE 32 // Movements longer than this are deliberate, and are not filtered
+#endif
+
+// The filtered position of each contact in Q4, so slow movements are not lost to rounding
+typedef struct {
+    uint32_t x;
+    uint32_t y;
+} jitter_state_t;
+
+static jitter_state_t jitter_state[NUM_FINGERS] = {};
+static uint8_t jitter_weight = 0;
+#endif
+
+// Recovery from a bad baseline. After ESD or a temperature swing the references can be left wrong, giving phantom
+// contacts which never move or negative deltas where nothing is touching (anti-touch) until the chip's slow automatic
+// calibration catches up. We look for both, and force a calibration through T6 when we see them. A finger can rest
+// without moving too, so a stuck contact only forces a calibration once the T37 deltas show anti-touch as well.
+// Contacts are suppressed until the calibration completes. Define MXT_RECALIBRATION to enable it.
+#ifdef MXT_RECALIBRATION
+#ifndef MXT_STUCK_TIME_MS
+#define MXT_STUCK_TIME_MS 30000 // A contact which doesn't move for this long is checked for being a phantom
+#endif
+#ifndef MXT_STUCK_DISTANCE
+#define MXT_STUCK_DISTANCE 8 // Movement smaller than this, in samples, doesn't count as moving
+#endif
+#ifndef MXT_DRIFT_CHECK_MS
+#define MXT_DRIFT_CHECK_MS 2000 // How often the deltas are checked for anti-touch while nothing is touching
+#endif
+#ifndef MXT_ANTITOUCH_THRESHOLD
+#define MXT_ANTITOUCH_THRESHOLD 40 // A node this far below its reference is anti-touch
+#endif
+#ifndef MXT_ANTITOUCH_NODES
+#define MXT_ANTITOUCH_NODES 3 // The number of anti-touch nodes which trigger a calibration
+#endif
+#ifndef MXT_RECALIBRATION_TIMEOUT_MS
+#define MXT_RECALIBRATION_TIMEOUT_MS 1000 // Stop suppressing contacts if the chip never reports the calibration ending
+#endif
+#ifndef MXT_DRIFT_PAGE_TIMEOUT_MS
+#define MXT_DRIFT_PAGE_TIMEOUT_MS 100 // Give up on a check whose T37 page the chip hasn't produced in this time
+#endif
+
+typedef struct {
+    uint16_t stuck_contacts;   // Calibrations forced by a contact which stopped moving, confirmed by anti-touch
+    uint16_t resting_contacts; // Stuck contacts the deltas showed to be a finger at rest
+    uint16_t anti_touches;     // Calibrations forced by negative deltas
+    uint16_t timeouts;         // Calibrations which never reported completion
+    uint16_t last_recovery_ms; // From forcing a calibration until the chip reported it complete
+    uint16_t max_recovery_ms;
+} recalibration_stats_t;
+
+static recalibration_stats_t recalibration_stats = {};
+static bool recalibrating = false;
+static uint32_t recalibration_time = 0;
+
+// The position of each contact when it last moved, and when that was
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint32_t time;
+} contact_motion_t;
+
+static contact_motion_t contact_motion[NUM_FINGERS] = {};
+
+// The anti-touch check reads the deltas one T37 page per drain, so it never holds up a report
+static const uint8_t DRIFT_IDLE = 0xFF;
+static uint8_t drift_page = DRIFT_IDLE;
+static uint16_t drift_nodes = 0;
+static uint32_t drift_check_time = 0;
+static uint32_t drift_page_time = 0; // When the current page was asked for
+static bool drift_confirming = false; // The check was started by a stuck contact
+static mxt_debug_diagnostic_t37 *t37_page = nullptr; // From the pool while a check is running
+#endif
+
+// Deep sleep between touches. The chip pulls CHG low whenever it has messages waiting, so once every contact is up
+// and T7 has dropped to its idle acquisition rate the MCU can sleep with only CHG armed to wake it, instead of polling.
+// Define MXT_CHG_PIN to enable it, and mxt_wait_for_chg() to enter the MCU's own deep sleep.
+#ifdef MXT_CHG_PIN
+#ifndef MXT_T7_TIMEOUT_UNIT_MS
+#define MXT_T7_TIMEOUT_UNIT_MS 200 // The unit of T7 actv2idelto
+#endif
+
+// How quickly the first touch after a sleep gets reported, from CHG waking the MCU to a contact coming out of
+// read_messages()
+typedef struct {
+    uint16_t sleeps;
+    uint16_t touch_wakes;      // Wakes which led to a contact being reported
+    uint16_t last_latency_ms;
+    uint16_t max_latency_ms;
+    uint32_t total_latency_ms; // Over all touch_wakes, for the average
+    uint32_t asleep_ms;
+} sleep_stats_t;
+
+static sleep_stats_t sleep_stats = {};
+static uint32_t last_touch_time = 0;
+static uint32_t wake_time = 0;
+static bool woken = false;
+#endif
+
+// Double tap to wake while the host is suspended. The chip recognises the double tap itself with T93, or T24 on older
+// firmware, and stops reporting contacts, so a brush against the sensor doesn't wake the MCU. The profile is applied
+// by mxt_suspend() and undone by mxt_resume(). Suspend writes the gesture object whole from the configuration image,
+// otherwise both write only the registers they change. Define MXT_WAKE_GESTURE to enable it.
+#ifdef MXT_WAKE_GESTURE
+#ifndef MXT_SUSPEND_IDLEACQINT
+#define MXT_SUSPEND_IDLEACQINT 100 // The idle acquisition interval while suspended, in ms
+#endif
+#ifndef MXT_SUSPEND_ACTACQINT
+#define MXT_SUSPEND_ACTACQINT 25 // The active acquisition interval while suspended, enough to time a double tap
+#endif
+
+static bool suspended = false;
+static bool wake_gesture = false;
+// The registers the suspend profile replaces, restored on resume
+static uint8_t resume_acqint[2] = {};
+#endif
+
+// A gate for the HID reports. Resting fingers keep producing MOVE messages with the same or nearly the same position,
+// and the host gains nothing from seeing them. The gate compares the state against the last report sent, and only lets
+// a report through when a contact changed by more than MXT_REPORT_THRESHOLD or a keep-alive is due. Calling it once
+// per USB poll coalesces all the frames drained since the last poll into one report. Define MXT_REPORT_GATE to enable
+// it.
+#ifdef MXT_REPORT_GATE
+#ifndef MXT_REPORT_THRESHOLD
+#define MXT_REPORT_THRESHOLD 0 // Position and contact size changes up to this many samples are not reported
+#endif
+#ifndef MXT_REPORT_PRESSURE_THRESHOLD
+#define MXT_REPORT_PRESSURE_THRESHOLD 0 // Pressure changes up to this much are not reported
+#endif
+#ifndef MXT_REPORT_KEEPALIVE_MS
+#define MXT_REPORT_KEEPALIVE_MS 0 // Resend the contacts at least this often while touching, 0 to never resend
+#endif
+static_assert(NUM_FINGERS <= 16, "The dirty mask has one bit per contact");
+
+typedef struct {
+    uint32_t polls;
+    uint32_t reports;
+    uint32_t keepalives;
+} report_gate_stats_t;
+
+static report_gate_stats_t report_gate_stats = {};
+static digitizer_t last_report = {};
+static uint32_t last_report_time = 0;
+#endif
+
+// Fleet telemetry, a fixed block of counters, gauges and histograms read by tools/mxt_metrics over raw HID. The hot
+// path only ever increments a counter or a bucket. Define MXT_METRICS to enable it.
+#ifdef MXT_METRICS
+static constexpr mxt_metrics_block empty_metrics_block(void)
+{
+    mxt_metrics_block block = {};
+    block.version = MXT_METRICS_VERSION;
+    block.num_counters = MXT_NUM_COUNTERS;
+    block.num_gauges = MXT_NUM_GAUGES;
+    block.num_histograms = MXT_NUM_HISTOGRAMS;
+    block.num_buckets = MXT_HISTOGRAM_BUCKETS;
+    return block;
 }
 
-void write_configuration(void)
+static mxt_metrics_block metrics = empty_metrics_block();
+static uint32_t metrics_second_start = 0;
+static uint32_t metrics_second_reports = 0;
+static uint32_t metrics_last_report = 0;
+
+static void metrics_sample(uint8_t histogram, uint32_t value)
 {
-    /////////////////////////////////////////
-    // T7: Configure power saving features //
-    /////////////////////////////////////////
-    if (t7_powerconfig_address)
-    {
-        mxt_gen_powerconfig_t7 t7 = {};
-        t7.idleacqint = 32;                             // The acquisition interval while in idle mode
-        t7.actacqint = 10;                              // The acquisition interval while in active mode
-        t7.actv2idelto = 50;                            // The timeout for transitioning from active to idle mode
-        t7.cfg = T7_CFG_ACTVPIPEEN | T7_CFG_IDLEPIPEEN; // Enable pipelining in both active and idle mode
+    const uint8_t bucket = std::bit_width(value);
+    metrics.histograms[histogram][bucket < MXT_HISTOGRAM_BUCKETS ? bucket : MXT_HISTOGRAM_BUCKETS - 1]++;
+}
 
-        I2C_Write(MXT336UD_ADDRESS, t7_powerconfig_address, (uint8_t *)&t7, sizeof(mxt_gen_powerconfig_t7));
-    }
+#define METRIC_COUNT(counter) (metrics.counters[counter]++)
+#define METRIC_SET(gauge, value) (metrics.gauges[gauge] = (value))
+#define METRIC_SAMPLE(histogram, value) metrics_sample(histogram, value)
+#else
+#define METRIC_COUNT(counter) ((void)0)
+#define METRIC_SET(gauge, value) ((void)0)
+#define METRIC_SAMPLE(histogram, value) ((void)0)
+#endif
 
-    ////////////////////////////////////////
-    // T8: Configure capacitive acquision //
-    ////////////////////////////////////////
-    if (t8_acquisitionconfig_address)
+// Live streaming of the trace ring and T37 delta pages over raw HID, see tools/mxt_stream. The stream consumes the
+// same ring as print_trace(), and is sent from mxt_stream_task() so it never holds up the drain. While T37 is being
+// streamed the stream is its only user, the anti-touch check waits until it stops. Define MXT_STREAM, along with
+// MXT_RAW_HID, to enable it.
+#ifdef MXT_STREAM
+#ifndef MXT_STREAM_BURST
+#define MXT_STREAM_BURST 4 // Packets sent per call of mxt_stream_task(), enough to keep the endpoint busy between calls
+#endif
+#ifndef MXT_STREAM_T37_TIMEOUT_MS
+#define MXT_STREAM_T37_TIMEOUT_MS 100 // Give up on a T37 page the chip hasn't produced in this time
+#endif
+
+static uint8_t stream_sources = 0;
+static uint16_t stream_credits = 0;
+static uint16_t stream_sequence = 0;
+static mxt_stream_stats stream_stats = {};
+
+// The T37 frame being sent, and how far through it we are
+static mxt_debug_diagnostic_t37 *stream_frame = nullptr; // From the pool while T37 is being streamed
+static uint8_t stream_frame_offset = sizeof(mxt_debug_diagnostic_t37);
+static uint8_t stream_t37_page = 0;
+static bool stream_t37_requested = false;
+static uint32_t stream_t37_request_time = 0;
+#ifdef MXT_RECALIBRATION
+static uint16_t stream_loan = 0; // Budget borrowed from the anti-touch check for the frame
+#endif
+#endif
+
+// Live tuning over raw HID, see tools/mxt_tune. Fields are staged and then written by a commit, adjacent fields in
+// one write, with T100 reports paused while there is more than one, so the host only sees frames from before or after
+// the change. Define MXT_TUNING, along with MXT_RAW_HID, to enable it.
+#ifdef MXT_TUNING
+#ifndef MXT_TUNE_STAGE_SIZE
+#define MXT_TUNE_STAGE_SIZE 128 // Bytes of field data which can be staged for one commit
+#endif
+#ifndef MXT_TUNE_MAX_FIELDS
+#define MXT_TUNE_MAX_FIELDS 16 // Fields which can be staged for one commit
+#endif
+
+typedef struct {
+    uint16_t address; // The register the field starts at
+    uint8_t type;
+    uint8_t instance;
+    uint8_t offset;
+    uint8_t length;
+    uint8_t data_offset; // Where the field's bytes sit in tune_data and tune_undo
+} tune_field_t;
+
+static tune_field_t tune_fields[MXT_TUNE_MAX_FIELDS] = {};
+// Taken from the pool when the first field is staged, and given back by the commit
+static uint8_t *tune_data = nullptr;
+static uint8_t *tune_undo = nullptr; // The values the fields held before the commit
+static uint8_t tune_num_fields = 0;
+static uint8_t tune_data_used = 0;
+static_assert(MXT_TUNE_STAGE_SIZE <= 255, "tune_field_t.data_offset is a byte");
+#endif
+
+// A host which goes away mid stream or mid tune never sends the stop or discard, so what it started is dropped, and
+// its pool regions given back, once it has sent nothing for this long. The stream tool hands back credit at least
+// once a second, even when there is nothing to stream.
+#if defined(MXT_STREAM) || defined(MXT_TUNING)
+#ifndef MXT_RAW_HID_TIMEOUT_MS
+#define MXT_RAW_HID_TIMEOUT_MS 5000
+#endif
+static uint32_t raw_hid_last_packet = 0;
+static void raw_hid_timeout_task(void);
+#endif
+
+// Current driver state state
+// The CPI of the reported X and Y axes
+static uint16_t cpi_x = MXT_DEFAULT_DPI;
+static uint16_t cpi_y = MXT_DEFAULT_DPI;
+
+// A static pool for the buffers which only some features need, or only need some of the time: the trace ring, the
+// T37 pages read by the anti-touch check and the stream, and the tuning stage. Each subsystem owns a region of the
+// pool, sized by its MXT_POOL_*_BUDGET, and holds at most one buffer in it. The stream and the anti-touch check take
+// turns on T37, so with both enabled the stream has no budget of its own and borrows the check's page while it runs.
+// Every other default is the enabled feature's full need, so on its own the pool saves no RAM over separate buffers:
+// the saving comes from building with smaller budgets and moving budget between subsystems at runtime with
+// mxt_pool_reassign(), for example giving the trace ring over to T37 streaming. get_pool_report() shows how much each
+// one has used.
+#ifdef MXT_POOL
+#define MXT_POOL_ALIGN 4
+#define POOL_ROUND(size) (((size) + MXT_POOL_ALIGN - 1) & ~(MXT_POOL_ALIGN - 1))
+
+#ifndef MXT_POOL_TRACE_BUDGET
+#ifdef MXT_TRACE_LENGTH
+#define MXT_POOL_TRACE_BUDGET (MXT_TRACE_LENGTH * MXT_TRACE_SAMPLE_SIZE)
+#else
+#define MXT_POOL_TRACE_BUDGET 0
+#endif
+#endif
+#ifndef MXT_POOL_DRIFT_BUDGET
+#ifdef MXT_RECALIBRATION
+#define MXT_POOL_DRIFT_BUDGET sizeof(mxt_debug_diagnostic_t37)
+#else
+#define MXT_POOL_DRIFT_BUDGET 0
+#endif
+#endif
+#ifndef MXT_POOL_STREAM_BUDGET
+#if defined(MXT_STREAM) && !defined(MXT_RECALIBRATION)
+#define MXT_POOL_STREAM_BUDGET sizeof(mxt_debug_diagnostic_t37)
+#else
+#define MXT_POOL_STREAM_BUDGET 0
+#endif
+#endif
+#ifndef MXT_POOL_TUNING_BUDGET
+#ifdef MXT_TUNING
+#define MXT_POOL_TUNING_BUDGET (2 * MXT_TUNE_STAGE_SIZE)
+#else
+#define MXT_POOL_TUNING_BUDGET 0
+#endif
+#endif
+
+static constexpr uint16_t pool_default_budgets[MXT_POOL_SUBSYSTEMS] = {
+    POOL_ROUND(MXT_POOL_TRACE_BUDGET),
+    POOL_ROUND(MXT_POOL_DRIFT_BUDGET),
+    POOL_ROUND(MXT_POOL_STREAM_BUDGET),
+    POOL_ROUND(MXT_POOL_TUNING_BUDGET),
+};
+static constexpr uint16_t pool_size = std::accumulate(std::begin(pool_default_budgets), std::end(pool_default_budgets), 0);
+static_assert(pool_size > 0, "Give at least one pool subsystem a budget");
+
+static constexpr mxt_pool_report empty_pool_report(void)
+{
+    mxt_pool_report report = {};
+    report.size = pool_size;
+    report.num_subsystems = MXT_POOL_SUBSYSTEMS;
+    for (int i = 0; i < MXT_POOL_SUBSYSTEMS; i++)
     {
-        mxt_gen_acquisitionconfig_t8 t8 = {};
-        // Currently just use the defaults
-        I2C_Write(MXT336UD_ADDRESS, t8_acquisitionconfig_address, (uint8_t *)&t8, sizeof(mxt_gen_acquisitionconfig_t8));
+        report.subsystems[i].budget = pool_default_budgets[i];
     }
+    return report;
+}
 
-    //////////////////////////////////////////////////////////////
-    // T46: Mutural Capacitive Touch Engine (CTE) configuration //
-    //////////////////////////////////////////////////////////////
-    if (t46_cte_config_address)
+alignas(MXT_POOL_ALIGN) static uint8_t pool[pool_size] = {};
+static mxt_pool_report pool_report = empty_pool_report();
+
+// Take the subsystem's buffer, growing or shrinking it if it already holds one. Returns nullptr if the size is over
+// its budget.
+static void *pool_acquire(uint8_t subsystem, uint16_t size)
+{
+    mxt_pool_usage &usage = pool_report.subsystems[subsystem];
+    if (size > usage.budget)
     {
-        mxt_spt_cteconfig_t46 t46 = {};
-        // Currently just use the defaults
-        I2C_Write(MXT336UD_ADDRESS, t46_cte_config_address, (uint8_t *)&t46, sizeof(mxt_spt_cteconfig_t46));
+        usage.failures++;
+        return nullptr;
     }
+    pool_report.used = pool_report.used - usage.used + size;
+    usage.used = size;
+    usage.peak = size > usage.peak ? size : usage.peak;
+    pool_report.peak = pool_report.used > pool_report.peak ? pool_report.used : pool_report.peak;
 
-    //////////////////////////////////////////////////////////////////////////////////////////////////////
-    // T100: Touchscreen confguration - defines an area of the sensor to use as a trackpad/touchscreen. //
-    //       This object generates all our interesting report messages.                                 //
-    //////////////////////////////////////////////////////////////////////////////////////////////////////
-    if (t100_multiple_touch_touchscreen_address)
+    uint16_t offset = 0;
+    for (int i = 0; i < subsystem; i++)
     {
-        mxt_touch_multiscreen_t100 cfg = {};
-        int status = I2C_Read(MXT336UD_ADDRESS, t100_multiple_touch_touchscreen_address,
-                              (uint8_t *)&cfg, sizeof(mxt_touch_multiscreen_t100));
-        cfg.ctrl = T100_CTRL_RPTEN | T100_CTRL_ENABLE; // Enable the t100 object, and enable message reporting for the t100 object.1`
-                                                       // TODO: Generic handling of rotation/inversion for absolute mode?
-#ifdef DIGITIZER_INVERT_X
-        cfg.cfg1 = T100_CFG_SWITCHXY | T100_CFG_INVERTY; // Could also handle rotation, and axis inversion in hardware here
-#else
-        cfg.cfg1 = T100_CFG_SWITCHXY; // Could also handle rotation, and axis inversion in hardware here
-#endif
-        cfg.scraux = 0x1;                                              // AUX data: Report the number of touch events
-        cfg.numtch = NUM_FINGERS;                           // The number of touch reports we want to receive (upto 10)
-        cfg.xsize = information.matrix_x_size;                         // Make configurable as this depends on the sensor design.
-        cfg.ysize = information.matrix_y_size;                         // Make configurable as this depends on the sensor design.
-        cfg.xpitch = MXT_SENSOR_WIDTH_MM / information.matrix_x_size;  // Pitch between X-Lines (5mm + 0.1mm * XPitch).
-        cfg.ypitch = MXT_SENSOR_HEIGHT_MM / information.matrix_y_size; // Pitch between Y-Lines (5mm + 0.1mm * YPitch).
-        cfg.gain = MXT_GAIN;                                           // Single transmit gain for mutual capacitance measurements
-        cfg.dxgain = MXT_DX_GAIN;                                      // Dual transmit gain for mutual capacitance measurements (255 = auto calibrate)
-        cfg.tchthr = MXT_TOUCH_THRESHOLD;                              // Touch threshold
-        cfg.mrgthr = 5;                                                // Merge threshold
-        cfg.mrghyst = 5;                                               // Merge threshold hysteresis
-        cfg.movsmooth = 224;                                           // The amount of smoothing applied to movements, this tails off at higher speeds
-        cfg.movfilter = 4 & 0xF;                                       // The lower 4 bits are the speed response value, higher values reduce lag, but also smoothing
-
-        // These two fields implement a simple filter for reducing jitter, but large values cause the pointer to stick in place before moving.
-        cfg.movhysti = 6; // Initial movement hysteresis
-        cfg.movhystn = 4; // Next movement hysteresis
-
-        cfg.xrange = CPI_TO_SAMPLES(cpi, MXT_SENSOR_HEIGHT_MM); // CPI handling, adjust the reported resolution
-        cfg.yrange = CPI_TO_SAMPLES(cpi, MXT_SENSOR_WIDTH_MM);  // CPI handling, adjust the reported resolution
-
-        status = I2C_Write(MXT336UD_ADDRESS, t100_multiple_touch_touchscreen_address,
-                                (uint8_t *)&cfg, sizeof(mxt_touch_multiscreen_t100));
-        if (status != OK)
-        {
-            fprintf(stderr, "T100 Configuration failed: %d\n", status);
-        }
+        offset += pool_report.subsystems[i].budget;
     }
+    return pool + offset;
 }
 
-void initialize()
+static void pool_release(uint8_t subsystem)
 {
-    read_object_table();
-    write_configuration();
+    pool_report.used -= pool_report.subsystems[subsystem].used;
+    pool_report.subsystems[subsystem].used = 0;
 }
+#endif
 
-// The input digitizer_report is the previous digitizer state, we return a modified state 
-digitizer_t read_messages(digitizer_t digitizer_report)
-{
-    if (t44_message_count_address)
-    {
-        mxt_message_count message_count = {};
+// The trace recorder keeps the most recent decoded contact reports in a ring, so they can be captured on a host for
+// offline tuning (see tools/mxt_motion_pareto). Define MXT_TRACE_LENGTH, a power of two, to enable it.
+#ifdef MXT_TRACE_LENGTH
+static_assert((MXT_TRACE_LENGTH & (MXT_TRACE_LENGTH - 1)) == 0, "MXT_TRACE_LENGTH must be a power of two");
 
-        int status = I2C_Read(MXT336UD_ADDRESS, t44_message_count_address, (uint8_t *)&message_count, sizeof(mxt_message_count));
-        if (status == OK)
-        {
-            for (int i = 0; i < message_count.count; i++)
-            {
-                mxt_message message = {};
-                status = I2C_Read(MXT336UD_ADDRESS, t5_message_processor_address,
-                                  (uint8_t *)&message, sizeof(mxt_message));
+typedef struct {
+    uint16_t time_ms; // Low bits of the timer, enough to measure the gaps between reports
+    uint8_t contact;
+    uint8_t event;
+    uint16_t x;
+    uint16_t y;
+} trace_sample_t;
 
-                if (message.report_id == t100_first_report_id)
-                {
-                    // Unused for now, but this report contains the number of contacts
-                }
-                else if ((message.report_id >= t100_subsequent_report_ids[0]) &&
-                         (message.report_id <= t100_subsequent_report_ids[t100_num_reports - 1]))
-                {
-                    const uint8_t contact_id = message.report_id - t100_subsequent_report_ids[0];
-                    int event = (message.data[0] & 0xf);
-                    uint16_t x = message.data[1] | (message.data[2] << 8);
-                    uint16_t y = message.data[3] | (message.data[4] << 8);
-                    bool tip = false
-                    if (event == DOWN)
-                    {
-                        digitizer_report.fingers[contact_id].tip = true;
-                    }
-                    if (event == UP || event == UNSUP || event == DOWNUP)
-                    {
-                        digitizer_report.fingers[contact_id].tip = 0;
-                    }
-                    digitizer_report.fingers[contact_id].confidence = !(event == SUP || event == DOWNSUP);
-                    if (event != UP)
-                    {
-                        digitizer_report.fingers[contact_id].x = x;
-                        digitizer_report.fingers[contact_id].y = y;
-                    }
-                }
-                else
-                {
-                    printf("Unhandled ID: %d (%d..%d) %d\n", message.report_id, t100_subsequent_report_ids[0], t100_subsequent_report_ids[t100_num_reports], t100_subsequent_report_ids[t100_num_reports - 1]);
-                }
-            }
-        }
-    }
-    return digitizer_report;
+static_assert(sizeof(trace_sample_t) == MXT_TRACE_SAMPLE_SIZE, "MXT_POOL_TRACE_BUDGET assumes 8 byte samples");
+
+// The ring is taken from the pool when the first sample arrives, as the largest power of two which fits the budget
+static trace_sample_t *trace_buffer = nullptr;
+static uint16_t trace_mask = 0;
+static uint16_t trace_head = 0;
+static uint16_t trace_tail = 0;
+static uint32_t trace_dropped = 0;
+#endif
+
+// The session journal keeps a summary of each touch session in a ring, so the real duty cycle of the touchpad can be
+// read back (see tools/mxt_journal). Each contact report costs a handful of arithmetic operations, and the session is
+// classified when it closes. Define MXT_JOURNAL to enable it.
+#ifdef MXT_JOURNAL
+#ifndef MXT_JOURNAL_LENGTH
+#define MXT_JOURNAL_LENGTH 16 // Sessions kept, 14 bytes each
+#endif
+#ifndef MXT_JOURNAL_TAP_MS
+#define MXT_JOURNAL_TAP_MS 200 // Sessions which barely move are taps if they are shorter than this, otherwise holds
+#endif
+#ifndef MXT_JOURNAL_MOVE_MM
+#define MXT_JOURNAL_MOVE_MM 3 // Sessions moving less than this barely move
+#endif
+static_assert(MXT_JOURNAL_LENGTH <= 255, "The journal length is a byte");
+
+typedef struct PACKED {
+    mxt_journal_header header;
+    mxt_journal_entry entries[MXT_JOURNAL_LENGTH];
+} journal_t;
+
+static constexpr journal_t empty_journal(void)
+{
+    journal_t journal = {};
+    journal.header.version = MXT_JOURNAL_VERSION;
+    journal.header.length = MXT_JOURNAL_LENGTH;
+    return journal;
 }
+
+// Where each contact was last reported, to measure how far it moved
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint32_t time;
+} journal_position_t;
+
+static journal_t journal = empty_journal();
+static mxt_journal_entry journal_session = {}; // The session in progress
+static journal_position_t journal_positions[NUM_FINGERS] = {};
+static uint8_t journal_contacts = 0;  // One bit for each contact down
+static uint32_t journal_path = 0;     // In reported samples, converted to mm when the session closes
+static uint32_t journal_speed = 0;    // In samples per second
+static bool journal_palm = false;
+static_assert(NUM_FINGERS <= 8, "journal_contacts has a bit per contact");
+#endif
+
+// A per board linearity correction, mapping reported positions to corrected positions with a small grid of offsets
+// which is interpolated bilinearly. Generate the grid with tools/mxt_linearity_fit and define MXT_LINEARITY_GRID
+// (along with MXT_LINEARITY_GRID_X/Y if it is not 5x5) to enable it.
+#ifdef MXT_LINEARITY_GRID
+#ifndef MXT_LINEARITY_GRID_X
+#define MXT_LINEARITY_GRID_X 5
+#endif
+#ifndef MXT_LINEARITY_GRID_Y
+#define MXT_LINEARITY_GRID_Y 5
+#endif
+
+typedef struct {
+    int8_t dx;
+    int8_t dy;
+} linearity_node_t;
+
+// Nodes are evenly spaced from 0 to the reported range on each axis, indexed [y][x]. The grid is fitted in the
+// default orientation.
+static const linearity_node_t linearity_grid[MXT_LINEARITY_GRID_Y][MXT_LINEARITY_GRID_X] = MXT_LINEARITY_GRID;
+
+// The grid in the current orientation, indexed [y * linearity_size_x + x]. It is rebuilt when the orientation
+// changes, so the correction never has to transform the contact.
+static linearity_node_t linearity_nodes[MXT_LINEARITY_GRID_X * MXT_LINEARITY_GRID_Y] = {};
+static uint8_t linearity_size_x = MXT_LINEARITY_GRID_X;
+static uint8_t linearity_size_y = MXT_LINEARITY_GRID_Y;
+
+// Grid cells per reported sample in Q16, so finding the cell is a multiply rather than a divide
+static uint32_t linearity_scale_x = 0;
+static uint32_t linearity_scale_y = 0;
+#endif
+
+// The contact ellipse is reported from the T100 area and vector aux data, define MXT_CONTACT_ELLIPSE to enable it. The
+// width, height and azimuth can then be added to the HID report as the Digitizer Width (0x48), Height (0x49) and
+// Azimuth (0x3F) usages, width and height share the logical range of X.
+#ifdef MXT_CONTACT_ELLIPSE
+// The diameter of a circle covering one node, in reported samples and Q8. Updated along with the ranges.
+static uint32_t ellipse_node_diameter = 0;
+#endif
+
+// A pseudo pressure from the T100 amplitude aux data, define MXT_CONTACT_PRESSURE to enable it and report the
+// pressure field as the Digitizer Tip Pressure (0x30) usage, from 0 to MXT_PRESSURE_MAX. The amplitude depends on the
+// contact size and on where it is on the sensor as well as on how hard it presses, so a per board calibration scales
+// it by the contact area and by a coarse grid of zones before mapping it through a response curve:
+//   MXT_PRESSURE_AREA_GAIN: 16 gains in Q8, indexed by the contact area in nodes (larger areas use the last one)
+//   MXT_PRESSURE_ZONE_GAIN: MXT_PRESSURE_ZONES_Y rows of MXT_PRESSURE_ZONES_X gains in Q8, in the default orientation
+//   MXT_PRESSURE_CURVE: 17 pressures for the scaled amplitudes 0, 16, ... 256, interpolated linearly
+// Any of them can be left out, and the pressure is then linear in the amplitude.
+#ifdef MXT_CONTACT_PRESSURE
+#ifndef MXT_PRESSURE_MAX
+#define MXT_PRESSURE_MAX 1023
+#endif
+#ifndef MXT_PRESS_THRESHOLD
+#define MXT_PRESS_THRESHOLD (MXT_PRESSURE_MAX * 3 / 5)
+#endif
+#ifndef MXT_RELEASE_THRESHOLD
+#define MXT_RELEASE_THRESHOLD (MXT_PRESSURE_MAX * 2 / 5)
+#endif
+static_assert(MXT_RELEASE_THRESHOLD < MXT_PRESS_THRESHOLD, "The press detector needs some hysteresis");
+
+#ifdef MXT_PRESSURE_AREA_GAIN
+static const uint16_t pressure_area_gain[16] = MXT_PRESSURE_AREA_GAIN;
+#endif
+
+#ifdef MXT_PRESSURE_ZONE_GAIN
+#ifndef MXT_PRESSURE_ZONES_X
+#define MXT_PRESSURE_ZONES_X 3
+#endif
+#ifndef MXT_PRESSURE_ZONES_Y
+#define MXT_PRESSURE_ZONES_Y 3
+#endif
+static const uint16_t pressure_zone_gain[MXT_PRESSURE_ZONES_Y][MXT_PRESSURE_ZONES_X] = MXT_PRESSURE_ZONE_GAIN;
+
+// The zones in the current orientation, indexed [y * pressure_zones_x + x], and the zones per reported sample in Q16
+static uint16_t pressure_zones[MXT_PRESSURE_ZONES_X * MXT_PRESSURE_ZONES_Y] = {};
+static uint8_t pressure_zones_x = MXT_PRESSURE_ZONES_X;
+static uint32_t pressure_zone_scale_x = 0;
+static uint32_t pressure_zone_scale_y = 0;
+#endif
+
+#ifdef MXT_PRESSURE_CURVE
+static const uint16_t pressure_curve[17] = MXT_PRESSURE_CURVE;
+#else
+static constexpr std::array<uint16_t, 17> pressure_curve = [] {
+    std::array<uint16_t, 17> curve = {};
+    for (int i = 0; i < 17; i++)
+    {
+        curve[i] = i * MXT_PRESSURE_MAX / 16;
+    }
+    return curve;
+}();
+#endif
+#endif
+
+// The rotation applied on top of the mounting orientation, as T100 cfg1 bits, see set_orientation()
+static uint8_t orientation = 0;
+
+// Capacitive keys on the same chip, define MXT_KEY_ARRAY as a mxt_key_array_geometry to enable them. The chip debounces
+// the keys, and their state arrives in the same drain as the touches.
+#ifdef MXT_KEY_ARRAY
+static constexpr mxt_key_array_geometry key_array = MXT_KEY_ARRAY;
+static_assert(key_array.keys() <= 32, "Too many keys for the key bitmap");
+static_assert(key_array.x_origin >= sensor.x_lines || key_array.y_origin >= sensor.y_lines,
+              "The keys overlap the touch sensor");
+#endif
+
+// The configuration we want the chip to run with, in the order the objects appear in the register map. The image
+// is built at compile time from the defaults below and the sensor geometry, so the checksum of the desired
+// configuration is a constant. Fields which change at runtime (such as a user selected CPI) are patched in with
+// config_image_patch(), which keeps the checksum up to date.
+typedef struct PACKED {
+    mxt_gen_powerconfig_t7 t7;
+    mxt_gen_acquisitionconfig_t8 t8;
+#ifdef MXT_KEY_ARRAY
+    mxt_touch_keyarray_t15 t15;
+#endif
+#ifdef MXT_WAKE_GESTURE
+    mxt_proci_onetouchgestureprocessor_t24 t24;
+#endif
+#ifdef MXT_TOUCH_SUPPRESSION
+    mxt_proci_touchsuppression_t42 t42;
+#endif
+    mxt_spt_cteconfig_t46 t46;
+#ifdef MXT_WAKE_GESTURE
+    mxt_proci_touchsequencelogger_t93 t93;
+#endif
+    mxt_touch_multiscreen_t100 t100;
+} mxt_config_image;
+
+#define CONFIG_IMAGE_OFFSET(object, field) \
+    (offsetof(mxt_config_image, object) + offsetof(decltype(mxt_config_image::object), field))
+
+// Patch a single field of the runtime configuration image
+#define CONFIG_IMAGE_SET(object, field, value)                                                            \
+    do                                                                                                    \
+    {                                                                                                     \
+        const decltype(mxt_config_image::object.field) config_value = (value);                            \
+        config_image_patch(CONFIG_IMAGE_OFFSET(object, field), (const uint8_t *)&config_value, sizeof(config_value)); \
+    } while (0)
+
+// Orientations are described with the T100 cfg1 bits. We take the inversions to act on the sensor axes before
+// SWITCHXY swaps them, so applying orientation 'then' after 'first' gives:
+static constexpr uint8_t orientation_compose(uint8_t first, uint8_t then)
+{
+    const bool switched = first & T100_CFG_SWITCHXY;
+    const uint8_t then_x = then & T100_CFG_INVERTX ? 1 : 0;
+    const uint8_t then_y = then & T100_CFG_INVERTY ? 1 : 0;
+    uint8_t result = (first ^ then) & T100_CFG_SWITCHXY;
+    if (((first & T100_CFG_INVERTX) ? 1 : 0) ^ (switched ? then_y : then_x))
+    {
+        result |= T100_CFG_INVERTX;
+    }
+    if (((first & T100_CFG_INVERTY) ? 1 : 0) ^ (switched ? then_x : then_y))
+    {
+        result |= T100_CFG_INVERTY;
+    }
+    return result;
+}
+
+// An object with every byte set to the fill
+template <typename T>
+static constexpr T filled_object(uint8_t fill)
+{
+    std::array<uint8_t, sizeof(T)> bytes = {};
+    bytes.fill(fill);
+    return std::bit_cast<T>(bytes);
+}
+
+// The T100 and gesture fields we don't set keep the chip's own values, they are filled in from the chip by
+// merge_device_defaults(). Building the image over two different fills shows which bytes those are.
+static constexpr mxt_config_image build_config_image(uint16_t cpi_x, uint16_t cpi_y, uint8_t fill = 0)
+{
+    mxt_config_image image = {};
+    image.t100 = filled_object<mxt_touch_multiscreen_t100>(fill);
+
+    /////////////////////////////////////////
+    // T7: Configure power saving features //
+    /////////////////////////////////////////
+    image.t7.idleacqint = 32;                             // The acquisition interval while in idle mode
+    image.t7.actacqint = 10;                              // The acquisition interval while in active mode
+    image.t7.actv2idelto = 50;                            // The timeout for transitioning from active to idle mode
+    image.t7.cfg = T7_CFG_ACTVPIPEEN | T7_CFG_IDLEPIPEEN; // Enable pipelining in both active and idle mode
+
+    ////////////////////////////////////////
+    // T8: Configure capacitive acquision //
+    ////////////////////////////////////////
+    // Currently just use the defaults
+
+#ifdef MXT_KEY_ARRAY
+    ///////////////////////////////////////////////////////////////////
+    // T15: Key array - the capacitive keys outside the touchpad.    //
+    ///////////////////////////////////////////////////////////////////
+    image.t15.ctrl = T15_CTRL_RPTEN | T15_CTRL_ENABLE; // Enable the keys, and report their state changes
+    image.t15.xorigin = key_array.x_origin;
+    image.t15.yorigin = key_array.y_origin;
+    image.t15.xsize = key_array.x_lines;
+    image.t15.ysize = key_array.y_lines;
+    image.t15.blen = MXT_GAIN;                          // Same gain as the touchpad
+    image.t15.tchthr = key_array.threshold;
+    image.t15.tchdi = 2;                                // Detect integration, the chip's debounce in acquisitions
+#endif
+
+#ifdef MXT_WAKE_GESTURE
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    // T24/T93: Gestures - off until mxt_suspend() turns them on, the timing is the chip's own.     //
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+    image.t24 = filled_object<mxt_proci_onetouchgestureprocessor_t24>(fill);
+    image.t24.ctrl = 0;
+    image.t93 = filled_object<mxt_proci_touchsequencelogger_t93>(fill);
+    image.t93.ctrl = 0;
+#endif
+
+#ifdef MXT_TOUCH_SUPPRESSION
+    //////////////////////////////////////////////////////////////////////////////////
+    // T42: Touch suppression - the chip recognises palms and other large contacts. //
+    //////////////////////////////////////////////////////////////////////////////////
+    image.t42.ctrl = T42_CTRL_RPTEN | T42_CTRL_ENABLE; // Enable suppression, and report when it starts and stops
+    image.t42.maxtcharea = MXT_SUPPRESSION_AREA;        // The largest area, in nodes, which is still a finger
+#endif
+
+    //////////////////////////////////////////////////////////////
+    // T46: Mutural Capacitive Touch Engine (CTE) configuration //
+    //////////////////////////////////////////////////////////////
+    // Currently just use the defaults
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////////
+    // T100: Touchscreen confguration - defines an area of the sensor to use as a trackpad/touchscreen. //
+    //       This object generates all our interesting report messages.                                 //
+    //////////////////////////////////////////////////////////////////////////////////////////////////////
+    mxt_touch_multiscreen_t100 &cfg = image.t100;
+    cfg.ctrl = T100_CTRL_RPTEN | T100_CTRL_ENABLE; // Enable the t100 object, and enable message reporting for the t100 object.1`
+#ifdef DIGITIZER_INVERT_X
+    cfg.cfg1 = orientation_compose(sensor.orientation, T100_CFG_INVERTX); // The mounting orientation, rotation at runtime is handled by set_orientation()
+#else
+    cfg.cfg1 = sensor.orientation; // The mounting orientation, rotation at runtime is handled by set_orientation()
+#endif
+    cfg.scraux = 0x1;                                           // AUX data: Report the number of touch events
+    uint8_t tchaux = 0;
+#ifdef MXT_CONTACT_ELLIPSE
+    tchaux |= T100_TCHAUX_VECT | T100_TCHAUX_AREA;              // AUX data: Report the shape of each contact
+#endif
+#ifdef MXT_CONTACT_PRESSURE
+    tchaux |= T100_TCHAUX_AMPL | T100_TCHAUX_AREA;              // AUX data: Report the signal strength and size of each contact
+#endif
+    cfg.tchaux = tchaux;
+    cfg.numtch = NUM_FINGERS;                                   // The number of touch reports we want to receive (upto 10)
+    cfg.xsize = sensor.x_lines;                                 // The lines in use depend on the sensor design.
+    cfg.ysize = sensor.y_lines;                                 // The lines in use depend on the sensor design.
+    cfg.xpitch = sensor.x_pitch() - MXT_MIN_PITCH;              // Pitch between X-Lines (5mm + 0.1mm * XPitch).
+    cfg.ypitch = sensor.y_pitch() - MXT_MIN_PITCH;              // Pitch between Y-Lines (5mm + 0.1mm * YPitch).
+    cfg.gain = MXT_GAIN;                                        // Single transmit gain for mutual capacitance measurements
+    cfg.dxgain = MXT_DX_GAIN;                                   // Dual transmit gain for mutual capacitance measurements (255 = auto calibrate)
+    cfg.tchthr = MXT_TOUCH_THRESHOLD;                           // Touch threshold
+    cfg.mrgthr = 5;                                             // Merge threshold
+    cfg.mrghyst = 5;                                            // Merge threshold hysteresis
+    cfg.movsmooth = 224;                                        // The amount of smoothing applied to movements, this tails off at higher speeds
+    cfg.movfilter = 4 & 0xF;                                    // The lower 4 bits are the speed response value, higher values reduce lag, but also smoothing
+
+    // These two fields implement a simple filter for reducing jitter, but large values cause the pointer to stick in place before moving.
+    cfg.movhysti = 6; // Initial movement hysteresis
+    cfg.movhystn = 4; // Next movement hysteresis
+
+    cfg.xrange = CPI_TO_SAMPLES(cpi_x, sensor.reported_width());  // CPI handling, adjust the reported resolution
+    cfg.yrange = CPI_TO_SAMPLES(cpi_y, sensor.reported_height()); // CPI handling, adjust the reported resolution
+
+    return image;
+}
+
+static constexpr uint32_t config_image_crc(const mxt_config_image &image)
+{
+    const auto bytes = std::bit_cast<std::array<uint8_t, sizeof(mxt_config_image)>>(image);
+    return mxt_crc24(bytes.data(), bytes.size());
+}
+
+static constexpr mxt_config_image default_config_image = build_config_image(MXT_DEFAULT_DPI, MXT_DEFAULT_DPI);
+
+// Each axis gets its own range, rounded to the nearest sample, so the CPI actually produced on an axis is off by at
+// most half a sample over its whole length. That is below the resolution of a single report, so no further scaling
+// of the positions is needed to make the axes match. The CPI is also read back from a range, by tune_commit() when
+// the range is tuned, which only gives back the CPI that was set when an axis is longer than an inch.
+static constexpr bool range_round_trips(uint16_t cpi, uint16_t length)
+{
+    const uint32_t range = CPI_TO_SAMPLES(cpi, length);
+    return SAMPLES_TO_CPI(range, length) == cpi;
+}
+static_assert(range_round_trips(MXT_DEFAULT_DPI, sensor.reported_width()), "The X range doesn't give back the CPI");
+static_assert(range_round_trips(MXT_DEFAULT_DPI, sensor.reported_height()), "The Y range doesn't give back the CPI");
+static constexpr uint32_t default_config_crc = config_image_crc(default_config_image);
+
+// Where each T100 aux byte lands in a contact message. They follow the position, in the order of their tchaux bits.
+static constexpr uint8_t t100_aux_index(uint8_t aux)
+{
+    return 5 + std::popcount((unsigned)(default_config_image.t100.tchaux & (aux - 1) & 0x7));
+}
+static constexpr uint8_t t100_message_size = 1 + t100_aux_index(0x8);
+static_assert(t100_message_size <= sizeof(mxt_message), "mxt_message is too small for the T100 aux data");
+
+// The bytes read for each message, the T100 contacts are the largest messages we decode
+static uint8_t message_read_size = t100_message_size;
+
+static mxt_config_image config_image = default_config_image;
+static uint32_t config_crc = default_config_crc;
+
+// x^(2^i) modulo the CRC polynomial, enough powers to advance a checksum over the whole image
+static constexpr auto crc24_powers = [] {
+    std::array<uint32_t, std::bit_width(sizeof(mxt_config_image) / 2 + 1)> powers = {};
+    uint32_t power = 2;
+    for (auto &p : powers)
+    {
+        p = power;
+        power = mxt_crc24_multiply(power, power);
+    }
+    return powers;
+}();
+
+// Update part of the configuration image, folding the change into the checksum. The CRC is linear, so the new
+// checksum is the old one XORed with the CRC of the changed bits. Words before the change contribute nothing, and
+// the words after it only multiply that CRC by x once each, which is done with a few multiplies by the powers
+// above rather than by clocking the rest of the image. Returns true if the image changed.
+static bool config_image_patch(uint16_t offset, const uint8_t *data, uint8_t length)
+{
+    uint8_t *image = (uint8_t *)&config_image;
+    const uint16_t end = offset + length;
+    uint32_t delta = 0;
+    bool changed = false;
+
+    for (uint16_t i = offset & ~1; i < end; i += 2)
+    {
+        uint8_t delta_bytes[2] = {0, 0};
+        for (int j = 0; j < 2; j++)
+        {
+            const uint16_t index = i + j;
+            if (index >= offset && index < end)
+            {
+                delta_bytes[j] = image[index] ^ data[index - offset];
+                image[index] = data[index - offset];
+            }
+        }
+        changed |= delta_bytes[0] || delta_bytes[1];
+        delta = mxt_crc24_word(delta, delta_bytes[0], delta_bytes[1]);
+    }
+    if (!changed)
+    {
+        return false;
+    }
+    uint16_t words_after = (sizeof(mxt_config_image) + 1) / 2 - (end + 1) / 2;
+    for (uint8_t i = 0; words_after; i++, words_after >>= 1)
+    {
+        if (words_after & 1)
+        {
+            delta = mxt_crc24_multiply(delta, crc24_powers[i]);
+        }
+    }
+    config_crc ^= delta;
+    return true;
+}
+
+// The bytes of an object build_config_image() sets, the rest are the chip's own
+template <typename T>
+static constexpr std::array<bool, sizeof(T)> managed_bytes(T mxt_config_image::*object)
+{
+    const auto zeros = std::bit_cast<std::array<uint8_t, sizeof(T)>>(build_config_image(MXT_DEFAULT_DPI, MXT_DEFAULT_DPI, 0x00).*object);
+    const auto ones = std::bit_cast<std::array<uint8_t, sizeof(T)>>(build_config_image(MXT_DEFAULT_DPI, MXT_DEFAULT_DPI, 0xFF).*object);
+    std::array<bool, sizeof(T)> managed = {};
+    for (size_t i = 0; i < managed.size(); i++)
+    {
+        managed[i] = zeros[i] == ones[i];
+    }
+    return managed;
+}
+
+static constexpr auto t100_managed = managed_bytes(&mxt_config_image::t100);
+#ifdef MXT_WAKE_GESTURE
+static constexpr auto t24_managed = managed_bytes(&mxt_config_image::t24);
+static constexpr auto t93_managed = managed_bytes(&mxt_config_image::t93);
+#endif
+
+// Copy the bytes of an object we don't set from the chip into the image
+static void merge_object_defaults(uint16_t address, uint16_t image_offset, const bool *managed, uint8_t size)
+{
+    uint8_t device[sizeof(mxt_touch_multiscreen_t100)];
+    if (!address || size > sizeof(device) || I2C_Read(mxt_address, address, device, size) != OK)
+    {
+        return;
+    }
+    for (uint8_t i = 0; i < size;)
+    {
+        uint8_t run = 0;
+        while (i + run < size && !managed[i + run])
+        {
+            run++;
+        }
+        if (run)
+        {
+            config_image_patch(image_offset + i, device + i, run);
+        }
+        i += run ? run : 1;
+    }
+}
+
+// The objects we only partly set keep the rest of their configuration as the chip had it, as the driver has always
+// left those fields alone. They are merged in once, before the first write, after that the image holds them.
+static bool device_defaults_merged = false;
+static void merge_device_defaults(void)
+{
+    if (device_defaults_merged)
+    {
+        return;
+    }
+    merge_object_defaults(t100_multiple_touch_touchscreen_address, offsetof(mxt_config_image, t100), t100_managed.data(),
+                          sizeof(mxt_touch_multiscreen_t100));
+#ifdef MXT_WAKE_GESTURE
+    merge_object_defaults(t24_gesture_address, offsetof(mxt_config_image, t24), t24_managed.data(),
+                          sizeof(mxt_proci_onetouchgestureprocessor_t24));
+    merge_object_defaults(t93_touch_sequence_address, offsetof(mxt_config_image, t93), t93_managed.data(),
+                          sizeof(mxt_proci_touchsequencelogger_t93));
+#endif
+    device_defaults_merged = true;
+}
+
+// The chip reports the checksum of its configuration in every T6 message. That covers every configuration object,
+// including the ones we leave alone, so after writing the image we ask for a report and remember the checksum which
+// goes with it. While the chip keeps reporting that checksum, and the image hasn't changed, the configuration is
+// still applied. A chip reset reloads the configuration from NV memory, so once the chip has confirmed our image the
+// image is written again after every reset. The driver's own runtime writes change the checksum too, see
+// config_patched().
+enum {
+    DEVICE_CONFIG_UNKNOWN,
+    DEVICE_CONFIG_PENDING, // Written, waiting for the chip to report its checksum
+    DEVICE_CONFIG_APPLIED
+};
+static uint8_t device_config_state = DEVICE_CONFIG_UNKNOWN;
+static uint32_t device_config_crc = 0; // The checksum the chip reported for the image
+static uint32_t applied_config_crc = 0; // The checksum of the image when it was written
+static bool device_config_lost = false;
+static bool device_config_confirmed = false; // The chip has reported a checksum for our image at least once
+
+// The driver has just changed the chip's configuration itself. The checksum the chip reports next is ours, rather
+// than a sign that something else changed it.
+static void config_patched(void)
+{
+    if (device_config_state == DEVICE_CONFIG_APPLIED)
+    {
+        applied_config_crc = config_crc;
+        device_config_state = DEVICE_CONFIG_PENDING;
+    }
+}
+
+// Read a block of registers, split into the largest transfers the bus driver supports. The transfers are issued
+// back to back so the block is read in one burst.
+static int read_registers(uint16_t address, uint8_t *data, uint16_t length)
+{
+    while (length)
+    {
+        const uint16_t chunk = length < MXT_MAX_TRANSFER_SIZE ? length : MXT_MAX_TRANSFER_SIZE;
+        int status = I2C_Read(mxt_address, address, data, chunk);
+        if (status != OK)
+        {
+            return status;
+        }
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    return OK;
+}
+
+static uint16_t object_address(const mxt_object_table_element *object)
+{
+    // Note: the address should be transmitted in network byte order
+    return (object->position_ms_byte << 8) | object->position_ls_byte;
+}
+
+#if defined(MXT_CONFIG_DUMP) || defined(MXT_TUNING)
+static uint16_t object_size(const mxt_object_table_element *object)
+{
+    return (object->size_minus_one + 1) * (object->instances_minus_one + 1);
+}
+#endif
+
+static void register_report_handler(int first_report_id, int num_report_ids, message_handler handler)
+{
+    if (!num_report_ids)
+    {
+        return;
+    }
+    if (num_report_handlers == MXT_MAX_REPORT_HANDLERS)
+    {
+        printf("No room to handle report IDs %d to %d\n", first_report_id, first_report_id + num_report_ids - 1);
+    }
+    else
+    {
+        report_handlers[num_report_handlers].first_report_id = first_report_id;
+        report_handlers[num_report_handlers].last_report_id = first_report_id + num_report_ids - 1;
+        report_handlers[num_report_handlers].handler = handler;
+        num_report_handlers++;
+    }
+}
+
+void read_object_table(void)
+{
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // First read the start of the information block to find out how many objects we have //
+    ////////////////////////////////////////////////////////////////////////////////////////
+    int status = I2C_Read(mxt_address, MXT_REG_INFORMATION_BLOCK, (uint8_t *)&information,
+                          sizeof(mxt_information_block));
+    if (status == OK)
+    {
+        // On Peacock the expected result is device family: 166 with 34 objects
+        printf("Found MXT %d:%d, fw %d.%d with %d objects. Matrix size %dx%d\n", information.family_id, information.variant_id,
+               information.version, information.build, information.num_objects, information.matrix_x_size, information.matrix_y_size);
+
+        /////////////////////////////////////////////////////////////////////////////////////////////
+        // Now read the object table to lookup the addresses and report_ids of the various objects //
+        /////////////////////////////////////////////////////////////////////////////////////////////
+        num_objects = information.num_objects;
+        if (num_objects > MXT_MAX_OBJECTS)
+        {
+            printf("Object table has %d objects, only using the first %d\n", num_objects, MXT_MAX_OBJECTS);
+            num_objects = MXT_MAX_OBJECTS;
+        }
+
+        // Read the whole table in one go, followed by the information block checksum which comes after it
+        status = read_registers(sizeof(mxt_information_block), (uint8_t *)object_table,
+                                num_objects * sizeof(mxt_object_table_element));
+        if (status == OK)
+        {
+            status = I2C_Read(mxt_address, sizeof(mxt_information_block) + information.num_objects * sizeof(mxt_object_table_element),
+                              information_crc, sizeof(information_crc));
+        }
+        if (status != OK)
+        {
+            printf("Failed to read object table. Status: %d\n", status);
+            num_objects = 0;
+            return;
+        }
+
+        // We accumulate report_ids as we walk the object table, the first report_id is 1.
+        int report_id = 1;
+        for (int i = 0; i < num_objects; i++)
+        {
+            const mxt_object_table_element &object = object_table[i];
+            const uint16_t address = object_address(&object);
+            switch (object.type)
+            {
+            case 2:
+                t2_encryption_status_address = address;
+                break;
+            case 5:
+                t5_message_processor_address = address;
+                t5_max_message_size = object.size_minus_one - 1;
+                if (message_read_size > t5_max_message_size + 1)
+                {
+                    message_read_size = t5_max_message_size + 1;
+                }
+                break;
+            case 6:
+                t6_command_processor_address = address;
+                register_report_handler(report_id, object.report_ids_per_instance, handle_t6_message);
+                break;
+            case 7:
+                t7_powerconfig_address = address;
+                break;
+            case 8:
+                t8_acquisitionconfig_address = address;
+                break;
+            case 37:
+                t37_diagnostic_address = address;
+                break;
+            case 42:
+                t42_touch_suppression_address = address;
+#ifdef MXT_TOUCH_SUPPRESSION
+                register_report_handler(report_id, object.report_ids_per_instance, handle_t42_message);
+#endif
+                break;
+            case 44:
+                t44_message_count_address = address;
+                break;
+            case 15:
+                t15_key_array_address = address;
+#ifdef MXT_KEY_ARRAY
+                register_report_handler(report_id, object.report_ids_per_instance, handle_t15_message);
+#endif
+                break;
+            case 97:
+                t97_ptc_keys_address = address;
+#ifdef MXT_KEY_ARRAY
+                register_report_handler(report_id, object.report_ids_per_instance, handle_t97_message);
+#endif
+                break;
+            case 24:
+                t24_gesture_address = address;
+#ifdef MXT_WAKE_GESTURE
+                register_report_handler(report_id, object.report_ids_per_instance, handle_t24_message);
+#endif
+                break;
+            case 93:
+                t93_touch_sequence_address = address;
+#ifdef MXT_WAKE_GESTURE
+                register_report_handler(report_id, object.report_ids_per_instance, handle_t93_message);
+#endif
+                break;
+            case 25:
+                t25_selftest_address = address;
+#ifdef MXT_SELFTEST
+                register_report_handler(report_id, object.report_ids_per_instance, handle_t25_message);
+#endif
+                break;
+            case 46:
+                t46_cte_config_address = address;
+                break;
+#ifdef MXT_NOISE_STATS
+            case 72:
+                register_report_handler(report_id, object.report_ids_per_instance, handle_t72_message);
+                break;
+#endif
+            case 100:
+                t100_multiple_touch_touchscreen_address = address;
+                register_report_handler(report_id, object.report_ids_per_instance, handle_t100_message);
+                break;
+            }
+            report_id += object.report_ids_per_instance * (object.instances_minus_one + 1);
+        }
+    }
+    else
+    {
+        printf("Failed to read object table. Status: %d\n", status);
+    }
+}
+
+#if defined(MXT_CONFIG_DUMP) || defined(MXT_TUNING)
+// Objects which hold configuration, as opposed to messages, commands, diagnostic data or status. Reading the
+// message processor also pops a message, so it must never be swept up in a bulk read.
+static bool object_is_config(uint8_t type)
+{
+    switch (type)
+    {
+    case 2:  // Encryption status
+    case 5:  // Message processor
+    case 6:  // Command processor
+    case 37: // Diagnostic debug
+    case 44: // Message count
+        return false;
+    default:
+        return true;
+    }
+}
+
+#ifdef MXT_CONFIG_DUMP
+// Read the configuration of every object on the chip into buffer, one object after another in object table order.
+// Objects which sit next to each other in the register map are coalesced into a single block read, so the whole
+// dump is a short burst of back to back transfers. Returns the number of bytes read, or -1 on failure.
+int read_configuration(uint8_t *buffer, uint16_t size)
+{
+    uint16_t used = 0;
+    uint16_t block_address = 0;
+    uint16_t block_length = 0;
+
+    for (int i = 0; i < num_objects; i++)
+    {
+        const mxt_object_table_element *object = &object_table[i];
+        if (!object_is_config(object->type))
+        {
+            continue;
+        }
+
+        const uint16_t address = object_address(object);
+        const uint16_t length = object_size(object);
+        if (used + length > size)
+        {
+            printf("Configuration does not fit in %d bytes\n", size);
+            return -1;
+        }
+
+        // Start a new block if this object does not carry straight on from the current one
+        if (block_length && address != block_address + block_length)
+        {
+            if (read_registers(block_address, buffer + used - block_length, block_length) != OK)
+            {
+                printf("Failed to read configuration at %d\n", block_address);
+                return -1;
+            }
+            block_length = 0;
+        }
+        if (!block_length)
+        {
+            block_address = address;
+        }
+        block_length += length;
+        used += length;
+    }
+
+    if (block_length && read_registers(block_address, buffer + used - block_length, block_length) != OK)
+    {
+        printf("Failed to read configuration at %d\n", block_address);
+        return -1;
+    }
+    return used;
+}
+
+static void print_raw_bytes(const uint8_t *data, uint16_t length)
+{
+    for (int i = 0; i < length; i++)
+    {
+        printf(" %02X", data[i]);
+    }
+    printf("\n");
+}
+
+// Print a configuration read with read_configuration() in the .raw format used by Microchip's tools, so a
+// capture of the console can be loaded, or diffed against another config with tools/mxt_raw_diff.
+void print_configuration(const uint8_t *config, uint16_t length)
+{
+    printf("OBP_RAW V1\n");
+    printf("%02X %02X %02X %02X %02X %02X %02X\n", information.family_id, information.variant_id, information.version,
+           information.build, information.matrix_x_size, information.matrix_y_size, information.num_objects);
+    printf("%02X%02X%02X\n", information_crc[2], information_crc[1], information_crc[0]);
+    printf("%06lX\n", (unsigned long)mxt_crc24(config, length));
+
+    uint16_t offset = 0;
+    for (int i = 0; i < num_objects && offset < length; i++)
+    {
+        const mxt_object_table_element &object = object_table[i];
+        if (!object_is_config(object.type))
+        {
+            continue;
+        }
+        for (int instance = 0; instance <= object.instances_minus_one; instance++)
+        {
+            printf("%04X %04X %04X", object.type, instance, object.size_minus_one + 1);
+            print_raw_bytes(config + offset, object.size_minus_one + 1);
+            offset += object.size_minus_one + 1;
+        }
+    }
+}
+
+#endif
+
+// Where each object we configure sits in the configuration image
+static const struct {
+    uint8_t type;
+    uint16_t image_offset;
+    uint16_t image_size;
+} config_image_objects[] = {
+    {7, offsetof(mxt_config_image, t7), sizeof(mxt_gen_powerconfig_t7)},
+    {8, offsetof(mxt_config_image, t8), sizeof(mxt_gen_acquisitionconfig_t8)},
+#ifdef MXT_KEY_ARRAY
+    {15, offsetof(mxt_config_image, t15), sizeof(mxt_touch_keyarray_t15)},
+#endif
+#ifdef MXT_WAKE_GESTURE
+    {24, offsetof(mxt_config_image, t24), sizeof(mxt_proci_onetouchgestureprocessor_t24)},
+#endif
+#ifdef MXT_TOUCH_SUPPRESSION
+    {42, offsetof(mxt_config_image, t42), sizeof(mxt_proci_touchsuppression_t42)},
+#endif
+    {46, offsetof(mxt_config_image, t46), sizeof(mxt_spt_cteconfig_t46)},
+#ifdef MXT_WAKE_GESTURE
+    {93, offsetof(mxt_config_image, t93), sizeof(mxt_proci_touchsequencelogger_t93)},
+#endif
+    {100, offsetof(mxt_config_image, t100), sizeof(mxt_touch_multiscreen_t100)},
+};
+
+#ifdef MXT_CONFIG_DUMP
+// Compare a configuration read with read_configuration() against the configuration image we write, printing every
+// byte which differs. Returns the number of differences.
+int diff_configuration(const uint8_t *config, uint16_t length)
+{
+    const auto &expected = config_image_objects;
+    const uint8_t *image = (const uint8_t *)&config_image;
+    int differences = 0;
+
+    uint16_t offset = 0;
+    for (int i = 0; i < num_objects && offset < length; i++)
+    {
+        const mxt_object_table_element &object = object_table[i];
+        if (!object_is_config(object.type))
+        {
+            continue;
+        }
+        for (const auto &e : expected)
+        {
+            if (e.type != object.type)
+            {
+                continue;
+            }
+            // Only the first instance is configured, and older firmware may have a shorter object than our image
+            const uint16_t compare = e.image_size < object.size_minus_one + 1 ? e.image_size : object.size_minus_one + 1;
+            for (int j = 0; j < compare && offset + j < length; j++)
+            {
+                if (config[offset + j] != image[e.image_offset + j])
+                {
+                    printf("T%d[%d]: device %02X, expected %02X\n", object.type, j, config[offset + j], image[e.image_offset + j]);
+                    differences++;
+                }
+            }
+        }
+        offset += object_size(&object);
+    }
+    printf("%d configuration differences\n", differences);
+    return differences;
+}
+#endif
+#endif
+
+void write_configuration(void)
+{
+    if (sensor.x_lines > information.matrix_x_size || sensor.y_lines > information.matrix_y_size)
+    {
+        printf("Sensor uses %dx%d lines, but the chip only has %dx%d\n", sensor.x_lines, sensor.y_lines,
+               information.matrix_x_size, information.matrix_y_size);
+    }
+#ifdef MXT_KEY_ARRAY
+    if (key_array.x_origin + key_array.x_lines > information.matrix_x_size ||
+        key_array.y_origin + key_array.y_lines > information.matrix_y_size)
+    {
+        printf("Keys use lines up to %dx%d, but the chip only has %dx%d\n", key_array.x_origin + key_array.x_lines,
+               key_array.y_origin + key_array.y_lines, information.matrix_x_size, information.matrix_y_size);
+    }
+#endif
+
+    if (device_config_state == DEVICE_CONFIG_APPLIED && applied_config_crc == config_crc)
+    {
+        printf("Configuration already applied, CRC %06lX\n", (unsigned long)config_crc);
+        return;
+    }
+    merge_device_defaults();
+
+    if (t7_powerconfig_address)
+    {
+        I2C_Write(mxt_address, t7_powerconfig_address, (uint8_t *)&config_image.t7, sizeof(mxt_gen_powerconfig_t7));
+    }
+    if (t8_acquisitionconfig_address)
+    {
+        I2C_Write(mxt_address, t8_acquisitionconfig_address, (uint8_t *)&config_image.t8, sizeof(mxt_gen_acquisitionconfig_t8));
+    }
+#ifdef MXT_KEY_ARRAY
+    if (t15_key_array_address)
+    {
+        I2C_Write(mxt_address, t15_key_array_address, (uint8_t *)&config_image.t15, sizeof(mxt_touch_keyarray_t15));
+    }
+#endif
+#ifdef MXT_WAKE_GESTURE
+    if (t24_gesture_address)
+    {
+        I2C_Write(mxt_address, t24_gesture_address, (uint8_t *)&config_image.t24, sizeof(mxt_proci_onetouchgestureprocessor_t24));
+    }
+#endif
+#ifdef MXT_TOUCH_SUPPRESSION
+    if (t42_touch_suppression_address)
+    {
+        I2C_Write(mxt_address, t42_touch_suppression_address, (uint8_t *)&config_image.t42, sizeof(mxt_proci_touchsuppression_t42));
+    }
+#endif
+    if (t46_cte_config_address)
+    {
+        I2C_Write(mxt_address, t46_cte_config_address, (uint8_t *)&config_image.t46, sizeof(mxt_spt_cteconfig_t46));
+    }
+#ifdef MXT_WAKE_GESTURE
+    if (t93_touch_sequence_address)
+    {
+        I2C_Write(mxt_address, t93_touch_sequence_address, (uint8_t *)&config_image.t93, sizeof(mxt_proci_touchsequencelogger_t93));
+    }
+#endif
+    if (t100_multiple_touch_touchscreen_address)
+    {
+        int status = I2C_Write(mxt_address, t100_multiple_touch_touchscreen_address,
+                               (uint8_t *)&config_image.t100, sizeof(mxt_touch_multiscreen_t100));
+        if (status != OK)
+        {
+            fprintf(stderr, "T100 Configuration failed: %d\n", status);
+        }
+    }
+
+    // Have the chip report the checksum of its new configuration, handle_t6_message() records it
+    applied_config_crc = config_crc;
+    device_config_state = DEVICE_CONFIG_UNKNOWN;
+    uint8_t reportall = 1;
+    if (t6_command_processor_address &&
+        I2C_Write(mxt_address, t6_command_processor_address + offsetof(mxt_gen_commandprocessor_t6, reportall), &reportall,
+                  sizeof(reportall)) == OK)
+    {
+        device_config_state = DEVICE_CONFIG_PENDING;
+    }
+}
+
+#ifdef MXT_LINEARITY_GRID
+// Rebuild the grid for the current orientation and reported range. Each node moves to where the rotation puts
+// it, and its offset is rotated with it.
+static void linearity_update(void)
+{
+    const bool switched = orientation & T100_CFG_SWITCHXY;
+    const bool invert_x = orientation & T100_CFG_INVERTX;
+    const bool invert_y = orientation & T100_CFG_INVERTY;
+    linearity_size_x = switched ? MXT_LINEARITY_GRID_Y : MXT_LINEARITY_GRID_X;
+    linearity_size_y = switched ? MXT_LINEARITY_GRID_X : MXT_LINEARITY_GRID_Y;
+    for (int y = 0; y < MXT_LINEARITY_GRID_Y; y++)
+    {
+        for (int x = 0; x < MXT_LINEARITY_GRID_X; x++)
+        {
+            const int u = invert_x ? MXT_LINEARITY_GRID_X - 1 - x : x;
+            const int v = invert_y ? MXT_LINEARITY_GRID_Y - 1 - y : y;
+            const int8_t du = invert_x ? -linearity_grid[y][x].dx : linearity_grid[y][x].dx;
+            const int8_t dv = invert_y ? -linearity_grid[y][x].dy : linearity_grid[y][x].dy;
+            linearity_node_t &node = switched ? linearity_nodes[u * linearity_size_x + v] : linearity_nodes[v * linearity_size_x + u];
+            node.dx = switched ? dv : du;
+            node.dy = switched ? du : dv;
+        }
+    }
+
+    linearity_scale_x = config_image.t100.xrange ? ((uint32_t)(linearity_size_x - 1) << 16) / config_image.t100.xrange : 0;
+    linearity_scale_y = config_image.t100.yrange ? ((uint32_t)(linearity_size_y - 1) << 16) / config_image.t100.yrange : 0;
+}
+
+// Find the cell containing a position, and the position within it in Q8
+static void linearity_cell(uint16_t position, uint32_t scale, uint8_t grid_size, uint8_t &cell, uint16_t &fraction)
+{
+    const uint32_t grid_position = position * scale;
+    cell = grid_position >> 16;
+    fraction = (grid_position >> 8) & 0xFF;
+    if (cell >= grid_size - 1)
+    {
+        cell = grid_size - 2;
+        fraction = 256;
+    }
+}
+
+static uint16_t linearity_apply(uint16_t position, int32_t offset, uint16_t range)
+{
+    const int32_t corrected = position + offset;
+    return corrected < 0 ? 0 : corrected > range ? range : corrected;
+}
+
+// Bilinear interpolation between the four nodes around the contact, a handful of multiplies per contact
+static void linearity_correct(uint16_t &x, uint16_t &y)
+{
+    uint8_t cx, cy;
+    uint16_t fx, fy;
+    linearity_cell(x, linearity_scale_x, linearity_size_x, cx, fx);
+    linearity_cell(y, linearity_scale_y, linearity_size_y, cy, fy);
+
+    const linearity_node_t *row = &linearity_nodes[cy * linearity_size_x + cx];
+    const linearity_node_t &n00 = row[0];
+    const linearity_node_t &n01 = row[1];
+    const linearity_node_t &n10 = row[linearity_size_x];
+    const linearity_node_t &n11 = row[linearity_size_x + 1];
+    const int32_t dx = ((n00.dx * (256 - fx) + n01.dx * fx) * (256 - fy) + (n10.dx * (256 - fx) + n11.dx * fx) * fy + 32768) >> 16;
+    const int32_t dy = ((n00.dy * (256 - fx) + n01.dy * fx) * (256 - fy) + (n10.dy * (256 - fx) + n11.dy * fx) * fy + 32768) >> 16;
+    x = linearity_apply(x, dx, config_image.t100.xrange);
+    y = linearity_apply(y, dy, config_image.t100.yrange);
+}
+#endif
+
+#ifdef MXT_CONTACT_ELLIPSE
+static uint16_t isqrt(uint32_t value)
+{
+    uint32_t root = 0;
+    for (uint32_t bit = 1ul << 30; bit; bit >>= 2)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+// A node covers x_pitch * y_pitch, and a circle of the same area has a diameter of 2 * sqrt(area / pi)
+static void ellipse_update(void)
+{
+    const uint32_t node_size = isqrt((uint32_t)sensor.x_pitch() * sensor.y_pitch() << 16); // 0.1mm, Q8
+    const uint32_t cpi = (cpi_x + cpi_y) / 2;
+    ellipse_node_diameter = DIVIDE_UNSIGNED_ROUND(node_size * cpi / 254 * 289, 256); // 289 is 2 / sqrt(pi) in Q8
+}
+
+// atan(y / x) in degrees, indexed [|y|][|x|] by the vector components
+static const uint8_t ellipse_atan[9][9] = {
+    { 0,  0,  0,  0,  0,  0,  0,  0,  0},
+    {90, 45, 27, 18, 14, 11,  9,  8,  7},
+    {90, 63, 45, 34, 27, 22, 18, 16, 14},
+    {90, 72, 56, 45, 37, 31, 27, 23, 21},
+    {90, 76, 63, 53, 45, 39, 34, 30, 27},
+    {90, 79, 68, 59, 51, 45, 40, 36, 32},
+    {90, 81, 72, 63, 56, 50, 45, 41, 37},
+    {90, 82, 74, 67, 60, 54, 49, 45, 41},
+    {90, 83, 76, 69, 63, 58, 53, 49, 45},
+};
+
+// The length of the vector sets the aspect ratio of the ellipse, 1 + length / 4. The axes are stretched by the square
+// root of that and its reciprocal so the area is kept, in Q8 and indexed by |x| + |y|.
+static const uint16_t ellipse_stretch[16] = {256, 286, 314, 339, 362, 384, 405, 425, 443, 462, 479, 496, 512, 528, 543, 558};
+static const uint16_t ellipse_squash[16] = {256, 229, 209, 194, 181, 171, 162, 154, 148, 142, 137, 132, 128, 124, 121, 117};
+
+static void ellipse_decode(const mxt_message &message, finger_t &finger)
+{
+    const uint8_t area = message.data[t100_aux_index(T100_TCHAUX_AREA)];
+    const uint8_t vector = message.data[t100_aux_index(T100_TCHAUX_VECT)];
+    const int8_t vector_x = (int8_t)vector >> 4;
+    const int8_t vector_y = (int8_t)(vector << 4) >> 4;
+    const uint8_t length_x = vector_x < 0 ? -vector_x : vector_x;
+    const uint8_t length_y = vector_y < 0 ? -vector_y : vector_y;
+    const uint8_t length = length_x + length_y > 15 ? 15 : length_x + length_y;
+
+    // The diameter of a circle with the contact's area, sqrt(area) is taken in Q4
+    const uint32_t diameter = (ellipse_node_diameter * isqrt((uint32_t)area << 8) + 2048) >> 12;
+    const uint32_t major = (diameter * ellipse_stretch[length] + 128) >> 8;
+    const uint32_t minor = (diameter * ellipse_squash[length] + 128) >> 8;
+    finger.width = major > 0xFFFF ? 0xFFFF : major;
+    finger.height = minor > 0xFFFF ? 0xFFFF : minor;
+
+    // An ellipse looks the same turned through 180 degrees, so fold the angle into 0-179
+    const uint8_t angle = ellipse_atan[length_y][length_x];
+    finger.azimuth = (vector_x < 0) != (vector_y < 0) && angle ? 180 - angle : angle;
+}
+#endif
+
+#ifdef MXT_CONTACT_PRESSURE
+#ifdef MXT_PRESSURE_ZONE_GAIN
+// Rebuild the zones for the current orientation and reported range, as linearity_update() does for its grid
+static void pressure_update(void)
+{
+    const bool switched = orientation & T100_CFG_SWITCHXY;
+    const bool invert_x = orientation & T100_CFG_INVERTX;
+    const bool invert_y = orientation & T100_CFG_INVERTY;
+    pressure_zones_x = switched ? MXT_PRESSURE_ZONES_Y : MXT_PRESSURE_ZONES_X;
+    const uint8_t pressure_zones_y = switched ? MXT_PRESSURE_ZONES_X : MXT_PRESSURE_ZONES_Y;
+    for (int y = 0; y < MXT_PRESSURE_ZONES_Y; y++)
+    {
+        for (int x = 0; x < MXT_PRESSURE_ZONES_X; x++)
+        {
+            const int u = invert_x ? MXT_PRESSURE_ZONES_X - 1 - x : x;
+            const int v = invert_y ? MXT_PRESSURE_ZONES_Y - 1 - y : y;
+            pressure_zones[switched ? u * pressure_zones_x + v : v * pressure_zones_x + u] = pressure_zone_gain[y][x];
+        }
+    }
+
+    // One more than the range, so the far edge still falls inside the last zone
+    pressure_zone_scale_x = ((uint32_t)pressure_zones_x << 16) / (config_image.t100.xrange + 1u);
+    pressure_zone_scale_y = ((uint32_t)pressure_zones_y << 16) / (config_image.t100.yrange + 1u);
+}
+#endif
+
+// Scale the amplitude for the contact's size and position, then map it through the response curve. The press
+// detector only compares against the threshold for the state it is in, so each message costs the same.
+static void pressure_decode(const mxt_message &message, finger_t &finger)
+{
+    uint32_t amplitude = message.data[t100_aux_index(T100_TCHAUX_AMPL)];
+#ifdef MXT_PRESSURE_AREA_GAIN
+    const uint8_t area = message.data[t100_aux_index(T100_TCHAUX_AREA)];
+    amplitude = (amplitude * pressure_area_gain[area < 15 ? area : 15] + 128) >> 8;
+#endif
+#ifdef MXT_PRESSURE_ZONE_GAIN
+    const uint32_t zone_x = (finger.x * pressure_zone_scale_x) >> 16;
+    const uint32_t zone_y = (finger.y * pressure_zone_scale_y) >> 16;
+    amplitude = (amplitude * pressure_zones[zone_y * pressure_zones_x + zone_x] + 128) >> 8;
+#endif
+    if (amplitude > 255)
+    {
+        amplitude = 255;
+    }
+
+    const uint8_t step = amplitude >> 4;
+    const uint8_t fraction = amplitude & 0xF;
+    finger.pressure = pressure_curve[step] + (((int32_t)pressure_curve[step + 1] - pressure_curve[step]) * fraction + 8) / 16;
+    finger.pressed = finger.pressed ? finger.pressure >= MXT_RELEASE_THRESHOLD : finger.pressure >= MXT_PRESS_THRESHOLD;
+}
+#endif
+
+// The physical length of the reported axes in the current orientation
+static uint16_t reported_width(void)
+{
+    return (config_image.t100.cfg1 & T100_CFG_SWITCHXY) ? sensor.height : sensor.width;
+}
+
+static uint16_t reported_height(void)
+{
+    return (config_image.t100.cfg1 & T100_CFG_SWITCHXY) ? sensor.width : sensor.height;
+}
+
+// Rebuild everything derived from the reported ranges and orientation
+static void update_range_tables(void)
+{
+#ifdef MXT_LINEARITY_GRID
+    linearity_update();
+#endif
+#ifdef MXT_CONTACT_ELLIPSE
+    ellipse_update();
+#endif
+#if defined(MXT_CONTACT_PRESSURE) && defined(MXT_PRESSURE_ZONE_GAIN)
+    pressure_update();
+#endif
+}
+
+// Recalculate the ranges, and everything derived from them, after the CPI or orientation changes
+static void update_ranges(void)
+{
+    CONFIG_IMAGE_SET(t100, xrange, CPI_TO_SAMPLES(cpi_x, reported_width()));
+    CONFIG_IMAGE_SET(t100, yrange, CPI_TO_SAMPLES(cpi_y, reported_height()));
+    update_range_tables();
+}
+
+static uint16_t clamp_cpi(uint16_t cpi)
+{
+    return cpi < 1 ? 1 : cpi > max_cpi ? max_cpi : cpi;
+}
+
+// Change the reported resolution of each axis. Only the range fields depend on the CPI, so only they are patched
+// and rewritten.
+void set_cpi_xy(uint16_t new_cpi_x, uint16_t new_cpi_y)
+{
+    cpi_x = clamp_cpi(new_cpi_x);
+    cpi_y = clamp_cpi(new_cpi_y);
+    update_ranges();
+    if (t100_multiple_touch_touchscreen_address)
+    {
+        I2C_Write(mxt_address, t100_multiple_touch_touchscreen_address + offsetof(mxt_touch_multiscreen_t100, xrange),
+                  (uint8_t *)&config_image.t100.xrange, sizeof(config_image.t100.xrange));
+        I2C_Write(mxt_address, t100_multiple_touch_touchscreen_address + offsetof(mxt_touch_multiscreen_t100, yrange),
+                  (uint8_t *)&config_image.t100.yrange, sizeof(config_image.t100.yrange));
+        config_patched();
+    }
+}
+
+void set_cpi(uint16_t new_cpi)
+{
+    set_cpi_xy(new_cpi, new_cpi);
+}
+
+// Rotate the reported axes clockwise, optionally mirroring them left to right afterwards. The rotation is done by
+// the chip, changing the cfg1 orientation bits and swapping the ranges when X and Y swap over. cfg1 through yrange
+// are written together, so the chip never sees a half applied orientation.
+void set_orientation(uint8_t rotation, bool mirror)
+{
+    static const uint8_t rotations[] = {
+        0,                                    // MXT_ROTATE_0
+        T100_CFG_SWITCHXY | T100_CFG_INVERTY, // MXT_ROTATE_90
+        T100_CFG_INVERTX | T100_CFG_INVERTY,  // MXT_ROTATE_180
+        T100_CFG_SWITCHXY | T100_CFG_INVERTX, // MXT_ROTATE_270
+    };
+    const uint8_t orientation_mask = T100_CFG_SWITCHXY | T100_CFG_INVERTX | T100_CFG_INVERTY;
+
+    orientation = rotations[rotation & 3];
+    if (mirror)
+    {
+        orientation = orientation_compose(orientation, T100_CFG_INVERTX);
+    }
+    const uint8_t mounting = default_config_image.t100.cfg1 & orientation_mask;
+    CONFIG_IMAGE_SET(t100, cfg1, (config_image.t100.cfg1 & ~orientation_mask) | orientation_compose(mounting, orientation));
+    update_ranges();
+    if (t100_multiple_touch_touchscreen_address)
+    {
+        I2C_Write(mxt_address, t100_multiple_touch_touchscreen_address + offsetof(mxt_touch_multiscreen_t100, cfg1),
+                  (uint8_t *)&config_image.t100.cfg1, offsetof(mxt_touch_multiscreen_t100, yedgecfg) - offsetof(mxt_touch_multiscreen_t100, cfg1));
+        config_patched();
+    }
+}
+
+// Change the T100 movement filters. movfilter through movhystn are contiguous, so this is a single write.
+void set_motion_filter(uint8_t movsmooth, uint8_t movfilter, uint16_t movhysti, uint16_t movhystn)
+{
+    CONFIG_IMAGE_SET(t100, movsmooth, movsmooth);
+    CONFIG_IMAGE_SET(t100, movfilter, movfilter & 0xF);
+    CONFIG_IMAGE_SET(t100, movhysti, movhysti);
+    CONFIG_IMAGE_SET(t100, movhystn, movhystn);
+    if (t100_multiple_touch_touchscreen_address)
+    {
+        I2C_Write(mxt_address, t100_multiple_touch_touchscreen_address + offsetof(mxt_touch_multiscreen_t100, movfilter),
+                  (uint8_t *)&config_image.t100.movfilter, offsetof(mxt_touch_multiscreen_t100, amplhyst) - offsetof(mxt_touch_multiscreen_t100, movfilter));
+        config_patched();
+    }
+}
+
+#ifdef MXT_TRACE_LENGTH
+// When the ring is full the oldest sample is dropped, the trace is only useful if it is recent
+static void trace_record(uint8_t contact, uint8_t event, uint16_t x, uint16_t y)
+{
+    if (!trace_buffer)
+    {
+        const uint16_t length = std::bit_floor((unsigned)(pool_report.subsystems[MXT_POOL_TRACE].budget / sizeof(trace_sample_t)));
+        trace_buffer = length ? (trace_sample_t *)pool_acquire(MXT_POOL_TRACE, length * sizeof(trace_sample_t)) : nullptr;
+        if (!trace_buffer)
+        {
+            return; // The budget has been given to another subsystem, tracing is off
+        }
+        trace_mask = length - 1;
+    }
+    trace_sample_t &sample = trace_buffer[trace_head & trace_mask];
+    sample.time_ms = timer_read32();
+    sample.contact = contact;
+    sample.event = event;
+    sample.x = x;
+    sample.y = y;
+    trace_head++;
+    if ((uint16_t)(trace_head - trace_tail) > trace_mask + 1)
+    {
+        trace_tail++;
+        trace_dropped++;
+    }
+}
+
+// Print and consume the recorded trace, one "<time_ms> <contact> <event> <x> <y>" line per sample
+void print_trace(void)
+{
+    if (trace_dropped)
+    {
+        printf("# dropped %lu\n", (unsigned long)trace_dropped);
+        trace_dropped = 0;
+    }
+    while (trace_tail != trace_head)
+    {
+        const trace_sample_t &sample = trace_buffer[trace_tail & trace_mask];
+        printf("%u %d %d %u %u\n", sample.time_ms, sample.contact, sample.event, sample.x, sample.y);
+        trace_tail++;
+    }
+}
+
+// Give the ring back to the pool, counting anything still in it as dropped
+static void trace_discard(void)
+{
+    trace_dropped += (uint16_t)(trace_head - trace_tail);
+    trace_tail = trace_head;
+    trace_buffer = nullptr;
+    pool_release(MXT_POOL_TRACE);
+}
+#endif
+
+#ifdef MXT_POOL
+// Move budget between two subsystems. Every region from one to the other either moves or changes size, so they must
+// all be free. The trace ring is always given up, as it only holds history, the other buffers belong to something
+// in progress (a stream, a drift check, staged fields) and the move fails until it finishes.
+bool mxt_pool_reassign(uint8_t from, uint8_t to, uint16_t bytes)
+{
+    bytes &= ~(MXT_POOL_ALIGN - 1);
+    if (from >= MXT_POOL_SUBSYSTEMS || to >= MXT_POOL_SUBSYSTEMS || from == to || bytes > pool_report.subsystems[from].budget)
+    {
+        return false;
+    }
+    const uint8_t first = from < to ? from : to;
+    const uint8_t last = from < to ? to : from;
+    for (int i = first; i <= last; i++)
+    {
+#ifdef MXT_TRACE_LENGTH
+        if (i == MXT_POOL_TRACE && trace_buffer)
+        {
+            trace_discard();
+        }
+#endif
+        if (pool_report.subsystems[i].used)
+        {
+            return false;
+        }
+    }
+    pool_report.subsystems[from].budget -= bytes;
+    pool_report.subsystems[to].budget += bytes;
+    return true;
+}
+
+const mxt_pool_report *get_pool_report(void)
+{
+    return &pool_report;
+}
+
+void print_pool_report(void)
+{
+    static const char *const names[] = {"trace", "drift", "stream", "tuning"};
+    static_assert(sizeof(names) / sizeof(*names) == MXT_POOL_SUBSYSTEMS, "Name every pool subsystem");
+    printf("pool: %u bytes, %u used, %u peak\n", pool_report.size, pool_report.used, pool_report.peak);
+    for (int i = 0; i < MXT_POOL_SUBSYSTEMS; i++)
+    {
+        const mxt_pool_usage &usage = pool_report.subsystems[i];
+        printf("  %s: budget %u, used %u, peak %u, failures %u\n", names[i], usage.budget, usage.used, usage.peak, usage.failures);
+    }
+}
+#endif
+
+#ifdef MXT_SCAN_PLANNER
+// Model the acquisition time of one frame in active mode, from the T46 burst parameters and the number of X and
+// Y lines in use. Every X line is driven in turn with all Y lines measured in parallel, so the burst length scales
+// with the X lines and the processing scales with the nodes.
+uint32_t scan_time_us(const mxt_spt_cteconfig_t46 &t46, uint8_t x_lines, uint8_t y_lines)
+{
+    const uint32_t syncs = t46.activesyncsperx ? t46.activesyncsperx : 1;
+    const uint32_t adcs = t46.adcspersync ? t46.adcspersync : 1;
+    const uint32_t pulses = t46.piusesperadc ? t46.piusesperadc : 1;
+    const uint32_t x_line_ns = syncs * adcs * pulses * MXT_PULSE_TIME_NS + MXT_X_LINE_OVERHEAD_NS;
+    return (x_lines * x_line_ns + (uint32_t)x_lines * y_lines * MXT_NODE_PROCESSING_NS) / 1000 + MXT_FRAME_OVERHEAD_US;
+}
+
+// Choose the T46 burst parameters for a target report rate. The noise in a measurement falls with the number of
+// pulses integrated per node, so we pick the combination with the most pulses which still fits the frame, then
+// set the active acquisition interval to match. Returns false if even the shortest burst does not fit, or if the
+// rate is slower than the acquisition interval, a byte of milliseconds, can express.
+#define MXT_MIN_REPORT_RATE_HZ 4
+bool plan_scan_rate(uint16_t report_rate_hz)
+{
+    if (report_rate_hz < MXT_MIN_REPORT_RATE_HZ)
+    {
+        printf("Can't plan a scan rate of %dHz\n", report_rate_hz);
+        return false;
+    }
+    const uint8_t x_lines = config_image.t100.xsize;
+    const uint8_t y_lines = config_image.t100.ysize;
+    const uint32_t budget_us = 1000000UL * MXT_SCAN_BUDGET_PERCENT / 100 / report_rate_hz;
+
+    mxt_spt_cteconfig_t46 best = {};
+    uint32_t best_pulses = 0;
+    uint32_t best_time_us = 0;
+    mxt_spt_cteconfig_t46 candidate = {};
+    for (uint8_t syncs = 4; syncs <= 64; syncs += 4)
+    {
+        for (uint8_t adcs = 1; adcs <= 4; adcs++)
+        {
+            for (uint8_t pulses = 1; pulses <= 8; pulses++)
+            {
+                candidate.activesyncsperx = syncs;
+                candidate.adcspersync = adcs;
+                candidate.piusesperadc = pulses;
+                const uint32_t time_us = scan_time_us(candidate, x_lines, y_lines);
+                const uint32_t total_pulses = (uint32_t)syncs * adcs * pulses;
+                if (time_us <= budget_us && (total_pulses > best_pulses || (total_pulses == best_pulses && time_us < best_time_us)))
+                {
+                    best = candidate;
+                    best_pulses = total_pulses;
+                    best_time_us = time_us;
+                }
+            }
+        }
+    }
+    if (!best_pulses)
+    {
+        printf("No scan settings fit %dHz with a %dx%d matrix\n", report_rate_hz, x_lines, y_lines);
+        return false;
+    }
+    printf("Scan plan for %dHz: %d syncs, %d ADCs, %d pulses, %lu of %luus\n", report_rate_hz, best.activesyncsperx,
+           best.adcspersync, best.piusesperadc, (unsigned long)best_time_us, (unsigned long)budget_us);
+
+    // Idle mode uses the same burst, so a touch is detected with the same SNR it will be tracked with
+    CONFIG_IMAGE_SET(t46, idlesyncsperx, best.activesyncsperx);
+    CONFIG_IMAGE_SET(t46, activesyncsperx, best.activesyncsperx);
+    CONFIG_IMAGE_SET(t46, adcspersync, best.adcspersync);
+    CONFIG_IMAGE_SET(t46, piusesperadc, best.piusesperadc);
+    CONFIG_IMAGE_SET(t7, actacqint, (1000 + report_rate_hz / 2) / report_rate_hz);
+    if (t46_cte_config_address)
+    {
+        // idlesyncsperx through piusesperadc are contiguous, so this is a single write
+        I2C_Write(mxt_address, t46_cte_config_address + offsetof(mxt_spt_cteconfig_t46, idlesyncsperx),
+                  (uint8_t *)&config_image.t46.idlesyncsperx, offsetof(mxt_spt_cteconfig_t46, xslew) - offsetof(mxt_spt_cteconfig_t46, idlesyncsperx));
+    }
+    if (t7_powerconfig_address)
+    {
+        I2C_Write(mxt_address, t7_powerconfig_address + offsetof(mxt_gen_powerconfig_t7, actacqint),
+                  (uint8_t *)&config_image.t7.actacqint, sizeof(config_image.t7.actacqint));
+    }
+    config_patched();
+    return true;
+}
+#endif
+
+// Each address is tried once, application addresses first, so a chip which is missing or stuck costs a fixed
+// handful of failed reads rather than a retry loop.
+static mxt_probe_result probe_addresses(void)
+{
+    static const uint8_t application_addresses[] = {MXT336UD_ADDRESS, MXT336UD_ALT_ADDRESS};
+    static const uint8_t bootloader_addresses[] = {MXT336UD_BOOTLOADER_ADDRESS, MXT336UD_ALT_BOOTLOADER_ADDRESS};
+    mxt_probe_result result = {};
+
+    for (uint8_t address : application_addresses)
+    {
+        mxt_information_block block = {};
+        if (I2C_Read(address, MXT_REG_INFORMATION_BLOCK, (uint8_t *)&block, sizeof(mxt_information_block)) == OK)
+        {
+            result.mode = MXT_MODE_APPLICATION;
+            result.address = address;
+            return result;
+        }
+    }
+    for (uint8_t address : bootloader_addresses)
+    {
+        uint8_t status = 0;
+        if (I2C_Receive(address, &status, sizeof(status)) == OK)
+        {
+            result.mode = (status & ~MXT_BOOT_STATUS_MASK) == MXT_BOOT_APP_CRC_FAIL ? MXT_MODE_BOOTLOADER_APP_CRC : MXT_MODE_BOOTLOADER;
+            result.address = address;
+            result.bootloader_status = status;
+            return result;
+        }
+    }
+    return result;
+}
+
+// Find the chip, and get it into application mode if we can. A chip in the bootloader with a good application
+// only needs a reset, one whose application failed its CRC needs reflashing so we don't waste time on it.
+mxt_probe_result probe_device(void)
+{
+    const uint32_t start = timer_read32();
+    mxt_probe_result result = probe_addresses();
+
+#ifdef MXT_RESET_PIN
+    if (result.mode == MXT_MODE_BOOTLOADER)
+    {
+        setPinOutput(MXT_RESET_PIN);
+        writePinLow(MXT_RESET_PIN);
+        wait_ms(1);
+        writePinHigh(MXT_RESET_PIN);
+        wait_ms(MXT_RESET_TIME_MS);
+        result = probe_addresses();
+    }
+#endif
+
+    if (result.mode == MXT_MODE_APPLICATION)
+    {
+        mxt_address = result.address;
+    }
+    result.elapsed_ms = timer_read32() - start;
+    return result;
+}
+
+void initialize()
+{
+    const mxt_probe_result probe = probe_device();
+    if (probe.mode != MXT_MODE_APPLICATION)
+    {
+        static const char *const modes[] = {"not found", "", "stuck in bootloader", "in bootloader, application CRC failed"};
+        printf("MXT %s (address %02X, status %02X) after %lums\n", modes[probe.mode], probe.address >> 1,
+               probe.bootloader_status, (unsigned long)probe.elapsed_ms);
+        return;
+    }
+    read_object_table();
+    write_configuration();
+    update_ranges();
+#ifdef MXT_CHG_PIN
+    setPinInputHigh(MXT_CHG_PIN);
+    last_touch_time = timer_read32();
+#endif
+
+#ifdef MXT_SELFTEST
+    // Self tests are run in the background, so they don't delay the first touch report
+    selftest_step = 0;
+    selftest_faults = {};
+    selftest_faults.state = t25_selftest_address ? SELFTEST_PENDING : SELFTEST_IDLE;
+#endif
+}
+
+#ifdef MXT_SELFTEST
+const selftest_faults_t *get_selftest_faults(void)
+{
+    return &selftest_faults;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// T6: Command processor status. Reports resets, configuration errors and calibration.             //
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+static void handle_t6_message(const mxt_message &message, [[maybe_unused]] uint8_t index, [[maybe_unused]] digitizer_t &digitizer)
+{
+    const uint32_t crc = message.data[1] | (uint32_t)message.data[2] << 8 | (uint32_t)message.data[3] << 16;
+    if (message.data[0] & T6_STATUS_RESET)
+    {
+        // A reset before the chip has confirmed our image is the one from power on, which came before our first write
+        device_config_lost = device_config_confirmed;
+        if (device_config_lost)
+        {
+            device_config_state = DEVICE_CONFIG_UNKNOWN;
+        }
+    }
+    else if (device_config_state == DEVICE_CONFIG_PENDING)
+    {
+        device_config_crc = crc;
+        device_config_state = DEVICE_CONFIG_APPLIED;
+        device_config_confirmed = true;
+    }
+    else if (device_config_state == DEVICE_CONFIG_APPLIED && crc != device_config_crc)
+    {
+        // Something else changed the configuration, write ours the next time we're asked to
+        device_config_state = DEVICE_CONFIG_UNKNOWN;
+    }
+#ifdef MXT_METRICS
+    if (message.data[0] & T6_STATUS_OFL)
+    {
+        METRIC_COUNT(MXT_COUNTER_OVERFLOWS);
+    }
+    if (message.data[0] & T6_STATUS_RESET)
+    {
+        METRIC_COUNT(MXT_COUNTER_RESETS);
+    }
+    if (message.data[0] & T6_STATUS_CFGERR)
+    {
+        METRIC_COUNT(MXT_COUNTER_CONFIG_ERRORS);
+    }
+#endif
+#ifdef MXT_RECALIBRATION
+    if (recalibrating && !(message.data[0] & T6_STATUS_CAL))
+    {
+        const uint32_t elapsed = timer_read32() - recalibration_time;
+        recalibration_stats.last_recovery_ms = elapsed > 0xFFFF ? 0xFFFF : elapsed;
+        if (recalibration_stats.last_recovery_ms > recalibration_stats.max_recovery_ms)
+        {
+            recalibration_stats.max_recovery_ms = recalibration_stats.last_recovery_ms;
+        }
+        recalibrating = false;
+    }
+#endif
+}
+
+#ifdef MXT_SELFTEST
+// Move on to the next test, or report once they have all run
+static void selftest_finish(bool passed)
+{
+    if (!passed)
+    {
+        selftest_faults.failed_tests++;
+    }
+    selftest_step++;
+    selftest_faults.state = selftest_step < sizeof(selftest_sequence) ? SELFTEST_PENDING : SELFTEST_DONE;
+    if (selftest_faults.state == SELFTEST_DONE)
+    {
+        printf("Self test: %d failed, X pins %llx, Y pins %llx, signal limit T%d\n", selftest_faults.failed_tests,
+               (unsigned long long)selftest_faults.x_pin_faults, (unsigned long long)selftest_faults.y_pin_faults,
+               selftest_faults.signal_limit_object);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// T25: Self test results. The pin fault test reports the faulty pin, the signal limit test reports //
+//      the object whose signals were out of range.                                                 //
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+static void handle_t25_message(const mxt_message &message, [[maybe_unused]] uint8_t index, [[maybe_unused]] digitizer_t &digitizer)
+{
+    const uint8_t result = message.data[0];
+    selftest_faults.last_result = result;
+    if (result == T25_RESULT_PIN_FAULT)
+    {
+        // data[1] is a sequence number, then the X and Y pins which failed
+        if (message.data[2] < 64)
+        {
+            selftest_faults.x_pin_faults |= 1ull << message.data[2];
+        }
+        if (message.data[3] < 64)
+        {
+            selftest_faults.y_pin_faults |= 1ull << message.data[3];
+        }
+    }
+    else if (result == T25_RESULT_SIGNAL_LIMIT)
+    {
+        selftest_faults.signal_limit_object = message.data[1];
+    }
+
+    if (selftest_faults.state == SELFTEST_RUNNING)
+    {
+        selftest_finish(result == T25_RESULT_PASS);
+    }
+}
+
+// Start the next self test once the message queue has been drained. A test briefly stops acquisition,
+// so we wait until no fingers are down to avoid disturbing a touch. A test which never reports is given up on, so
+// the anti-touch check, which waits for the tests, isn't held off for good.
+static void selftest_task(const digitizer_t &digitizer)
+{
+    if (selftest_faults.state == SELFTEST_RUNNING && timer_read32() - selftest_start_time >= MXT_SELFTEST_TIMEOUT_MS)
+    {
+        selftest_finish(false);
+    }
+    if (selftest_faults.state != SELFTEST_PENDING)
+    {
+        return;
+    }
+    for (int i = 0; i < NUM_FINGERS; i++)
+    {
+        if (digitizer.fingers[i].tip)
+        {
+            return;
+        }
+    }
+
+    mxt_spt_selftest_t25 t25 = {};
+    t25.ctrl = T25_CTRL_RPTEN | T25_CTRL_ENABLE;
+    t25.cmd = selftest_sequence[selftest_step];
+    if (I2C_Write(mxt_address, t25_selftest_address, (uint8_t *)&t25, sizeof(mxt_spt_selftest_t25)) == OK)
+    {
+        selftest_faults.state = SELFTEST_RUNNING;
+        selftest_start_time = timer_read32();
+        config_patched();
+    }
+}
+#endif
+
+#ifdef MXT_RECALIBRATION
+const recalibration_stats_t *get_recalibration_stats(void)
+{
+    return &recalibration_stats;
+}
+
+static void t6_command(uint8_t field, uint8_t value)
+{
+    I2C_Write(mxt_address, t6_command_processor_address + field, &value, sizeof(value));
+}
+
+static void drift_stop(void)
+{
+    drift_page = DRIFT_IDLE;
+    t37_page = nullptr;
+    pool_release(MXT_POOL_DRIFT);
+}
+
+// Give every contact a fresh stuck timer
+static void contact_motion_restart(uint32_t now)
+{
+    for (int i = 0; i < NUM_FINGERS; i++)
+    {
+        contact_motion[i].time = now;
+    }
+}
+
+static void recalibrate(uint16_t &cause)
+{
+    cause++;
+    t6_command(offsetof(mxt_gen_commandprocessor_t6, calibrate), 1);
+    recalibrating = true;
+    recalibration_time = timer_read32();
+    drift_stop();
+    drift_check_time = recalibration_time;
+    // Give any contact which survives the calibration a fresh stuck timer, rather than calibrating again straight away
+    contact_motion_restart(recalibration_time);
+}
+
+// Restart the stuck timer whenever a contact lands or moves far enough
+static void recalibration_track(uint8_t contact_id, bool down, uint16_t x, uint16_t y)
+{
+    contact_motion_t &motion = contact_motion[contact_id];
+    const uint16_t distance_x = x > motion.x ? x - motion.x : motion.x - x;
+    const uint16_t distance_y = y > motion.y ? y - motion.y : motion.y - y;
+    if (down || distance_x > MXT_STUCK_DISTANCE || distance_y > MXT_STUCK_DISTANCE)
+    {
+        motion.x = x;
+        motion.y = y;
+        motion.time = timer_read32();
+    }
+}
+
+// Step through the delta pages, counting nodes well below their reference. The chip fills T37 some time after each
+// T6 command, so a page which isn't ready yet is simply read again on the next drain. A stuck contact starts a
+// check straight away, to confirm it before calibrating.
+static void drift_check(uint32_t now, bool confirm)
+{
+    if (drift_page == DRIFT_IDLE)
+    {
+        if (confirm || now - drift_check_time >= MXT_DRIFT_CHECK_MS)
+        {
+            t37_page = (mxt_debug_diagnostic_t37 *)pool_acquire(MXT_POOL_DRIFT, sizeof(mxt_debug_diagnostic_t37));
+            if (!t37_page)
+            {
+                // The page's budget has been given away, skip this check. A stuck contact can't be confirmed, so it
+                // is left alone until it has been stuck for another MXT_STUCK_TIME_MS.
+                drift_check_time = now;
+                if (confirm)
+                {
+                    contact_motion_restart(now);
+                }
+                return;
+            }
+            drift_confirming = confirm;
+            drift_page = 0;
+            drift_nodes = 0;
+            drift_page_time = now;
+            t6_command(offsetof(mxt_gen_commandprocessor_t6, diagnostic), T6_DIAGNOSTIC_DELTAS);
+        }
+        return;
+    }
+
+    if (read_registers(t37_diagnostic_address, (uint8_t *)t37_page, sizeof(mxt_debug_diagnostic_t37)) != OK ||
+        t37_page->mode != T6_DIAGNOSTIC_DELTAS || t37_page->page != drift_page)
+    {
+        if (now - drift_page_time >= MXT_DRIFT_PAGE_TIMEOUT_MS)
+        {
+            // The chip reset or never produced the page. A stuck contact is left alone, as when there's no budget.
+            drift_stop();
+            drift_check_time = now;
+            if (drift_confirming)
+            {
+                contact_motion_restart(now);
+            }
+        }
+        return;
+    }
+    for (uint16_t i = 0; i < sizeof(t37_page->data); i += 2)
+    {
+        const int16_t delta = (int16_t)(t37_page->data[i] | (t37_page->data[i + 1] << 8));
+        if (delta < -MXT_ANTITOUCH_THRESHOLD)
+        {
+            drift_nodes++;
+        }
+    }
+
+    const uint16_t nodes = information.matrix_x_size * information.matrix_y_size;
+    const uint8_t pages = (nodes * 2 + sizeof(t37_page->data) - 1) / sizeof(t37_page->data);
+    if (++drift_page < pages)
+    {
+        drift_page_time = now;
+        t6_command(offsetof(mxt_gen_commandprocessor_t6, diagnostic), T6_DIAGNOSTIC_PAGE_UP);
+        return;
+    }
+    drift_stop();
+    drift_check_time = now;
+    if (drift_nodes >= MXT_ANTITOUCH_NODES)
+    {
+        recalibrate(drift_confirming ? recalibration_stats.stuck_contacts : recalibration_stats.anti_touches);
+    }
+    else if (drift_confirming)
+    {
+        // The baseline is good, so the stuck contact is a real finger resting on the pad
+        recalibration_stats.resting_contacts++;
+        contact_motion_restart(now);
+    }
+}
+
+// Run once the message queue has been drained. Contacts are held back while a calibration is in progress, otherwise
+// we check the deltas for anti-touch when nothing is touching, or when a contact has stopped moving for too long.
+static void recalibration_task(digitizer_t &digitizer)
+{
+    if (!t6_command_processor_address)
+    {
+        return;
+    }
+    const uint32_t now = timer_read32();
+    if (recalibrating)
+    {
+        if (now - recalibration_time >= MXT_RECALIBRATION_TIMEOUT_MS)
+        {
+            recalibration_stats.timeouts++;
+            recalibrating = false;
+        }
+        // Only contacts which are down, as for T42, so a lifted slot doesn't carry the flag into its next touch
+        for (int i = 0; i < NUM_FINGERS; i++)
+        {
+            if (digitizer.fingers[i].tip)
+            {
+                digitizer.fingers[i].confidence = false;
+            }
+        }
+        return;
+    }
+
+    bool touching = false;
+    bool stuck = false;
+    for (int i = 0; i < NUM_FINGERS; i++)
+    {
+        if (digitizer.fingers[i].tip)
+        {
+            touching = true;
+            stuck |= now - contact_motion[i].time >= MXT_STUCK_TIME_MS;
+        }
+    }
+    bool disturbed = !t37_diagnostic_address;
+#ifdef MXT_SELFTEST
+    disturbed |= selftest_faults.state == SELFTEST_RUNNING; // The self tests disturb the deltas too
+#endif
+#ifdef MXT_STREAM
+    disturbed |= stream_sources & MXT_STREAM_T37; // The stream owns T37 and the T6 diagnostic commands while it runs
+#endif
+    if (disturbed || (touching && !stuck))
+    {
+        // The check starts again from the first page. The deltas show anti-touch with nothing on the sensor, or
+        // around a phantom contact, a check started while idle is meaningless once a finger lands.
+        if (drift_page != DRIFT_IDLE)
+        {
+            drift_stop();
+        }
+        return;
+    }
+    if (stuck && drift_page != DRIFT_IDLE && !drift_confirming)
+    {
+        drift_stop();
+    }
+    drift_check(now, stuck);
+}
+#endif
+
+#ifdef MXT_KEY_ARRAY
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// T15/T97: Key arrays. Each message carries the state of every key in the array, so it replaces    //
+//          that array's bits in the digitizer state.                                               //
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// The message has a status byte, then a bitmap of the keys in detect, one bit per key
+static uint32_t key_bitmap(const mxt_message &message)
+{
+    return message.data[1] | (message.data[2] << 8) | (message.data[3] << 16) | ((uint32_t)message.data[4] << 24);
+}
+
+static void handle_t15_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer)
+{
+    if (index != 0)
+    {
+        return; // Only the first instance is configured
+    }
+    const uint32_t mask = key_array.keys() < 32 ? (1ul << key_array.keys()) - 1 : 0xFFFFFFFF;
+    digitizer.keys = (digitizer.keys & ~mask) | (key_bitmap(message) & mask);
+}
+
+// The T97 keys follow the T15 keys in the bitmap
+static void handle_t97_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer)
+{
+    if (index != 0 || key_array.keys() >= 32)
+    {
+        return;
+    }
+    const uint32_t mask = 0xFFFFFFFF << key_array.keys();
+    digitizer.keys = (digitizer.keys & ~mask) | ((key_bitmap(message) << key_array.keys()) & mask);
+}
+#endif
+
+#ifdef MXT_TOUCH_SUPPRESSION
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// T42: Touch suppression. Reports when the chip starts and stops suppressing touches because a    //
+//      palm or other large object is on the sensor.                                                //
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+static void handle_t42_message(const mxt_message &message, [[maybe_unused]] uint8_t index, [[maybe_unused]] digitizer_t &digitizer)
+{
+    touch_suppressed = message.data[0] & T42_STATUS_TCHSUP;
+}
+#endif
+
+#ifdef MXT_NOISE_STATS
+const noise_stats_t *get_noise_stats(void)
+{
+    return &noise_stats;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// T72: Noise suppression. Reports changes of burst frequency and noise state, along with the noise //
+//      levels it measured.                                                                         //
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+static void handle_t72_message(const mxt_message &message, [[maybe_unused]] uint8_t index, [[maybe_unused]] digitizer_t &digitizer)
+{
+    const uint8_t status = message.data[0];
+    const uint8_t state = message.data[1] & T72_STATE_MASK;
+    noise_stats.level = message.data[3];
+    if (message.data[2] > noise_stats.peak_level)
+    {
+        noise_stats.peak_level = message.data[2];
+    }
+    if (status & T72_STATUS_FREQCHG)
+    {
+        noise_stats.frequency_hops++;
+    }
+    if (state != noise_stats.state)
+    {
+        const uint32_t now = timer_read32();
+        if (noise_stats.state == T72_STATE_NOISY || noise_stats.state == T72_STATE_VERY_NOISY)
+        {
+            noise_stats.noisy_ms += now - noise_stats.state_time;
+        }
+        noise_stats.state = state;
+        noise_stats.state_time = now;
+        noise_stats.state_changes++;
+#ifdef MXT_JITTER_FILTER
+        jitter_weight = state == T72_STATE_VERY_NOISY ? MXT_JITTER_VERY_NOISY_WEIGHT
+                        : state == T72_STATE_NOISY    ? MXT_JITTER_NOISY_WEIGHT
+                                                      : 0;
+#endif
+    }
+}
+#endif
+
+#ifdef MXT_JITTER_FILTER
+// A recursive filter towards each new position. Large movements snap straight to the contact, so only the small
+// movements which are mostly noise see the extra latency.
+static void jitter_filter(uint8_t contact_id, bool down, uint16_t &x, uint16_t &y)
+{
+    jitter_state_t &state = jitter_state[contact_id];
+    const uint32_t in_x = (uint32_t)x << 4;
+    const uint32_t in_y = (uint32_t)y << 4;
+    const uint32_t distance_x = in_x > state.x ? in_x - state.x : state.x - in_x;
+    const uint32_t distance_y = in_y > state.y ? in_y - state.y : state.y - in_y;
+    if (down || !jitter_weight || distance_x > (MXT_JITTER_SNAP_DISTANCE << 4) || distance_y > (MXT_JITTER_SNAP_DISTANCE << 4))
+    {
+        state.x = in_x;
+        state.y = in_y;
+    }
+    else
+    {
+        state.x = (state.x * jitter_weight + in_x * (256 - jitter_weight) + 128) >> 8;
+        state.y = (state.y * jitter_weight + in_y * (256 - jitter_weight) + 128) >> 8;
+    }
+    x = (state.x + 8) >> 4;
+    y = (state.y + 8) >> 4;
+}
+#endif
+
+#ifdef MXT_JOURNAL
+const mxt_journal_header *get_journal(void)
+{
+    return &journal.header;
+}
+
+static uint16_t journal_mm(uint32_t samples)
+{
+    const uint32_t mm = samples * 254 / (cpi_x * 10);
+    return mm > 0xFFFF ? 0xFFFF : mm;
+}
+
+static void journal_close(uint32_t now)
+{
+    mxt_journal_entry &entry = journal_session;
+    entry.end_ms = now;
+    entry.path_mm = journal_mm(journal_path);
+    entry.max_speed = journal_mm(journal_speed);
+    const bool moved = entry.path_mm >= MXT_JOURNAL_MOVE_MM;
+    if (journal_palm)
+    {
+        entry.gesture = MXT_SESSION_PALM;
+    }
+    else if (entry.fingers >= 3)
+    {
+        entry.gesture = MXT_SESSION_MULTI_FINGER;
+    }
+    else if (entry.fingers == 2)
+    {
+        entry.gesture = moved ? MXT_SESSION_SCROLL : MXT_SESSION_TWO_FINGER_TAP;
+    }
+    else if (moved)
+    {
+        entry.gesture = MXT_SESSION_DRAG;
+    }
+    else
+    {
+        entry.gesture = now - entry.start_ms < MXT_JOURNAL_TAP_MS ? MXT_SESSION_TAP : MXT_SESSION_HOLD;
+    }
+    journal.entries[journal.header.sessions % MXT_JOURNAL_LENGTH] = entry;
+    journal.header.sessions++;
+}
+
+// Fold one contact report into the session, opening it on the first contact down and closing it when the last one
+// lifts. A suppressed contact makes the session a palm. Distances use max + 3/8 min, within 7% of the true length
+// without a square root.
+static void journal_track(uint8_t contact_id, bool down, bool touching, bool suppressed, uint16_t x, uint16_t y)
+{
+    const uint8_t bit = 1 << contact_id;
+    if (!journal_contacts && !down && !touching)
+    {
+        return;
+    }
+    const uint32_t now = timer_read32();
+    if (!journal_contacts)
+    {
+        journal_session = {};
+        journal_session.start_ms = now;
+        journal_path = 0;
+        journal_speed = 0;
+        journal_palm = false;
+    }
+    journal_palm |= suppressed;
+
+    journal_position_t &last = journal_positions[contact_id];
+    if ((journal_contacts & bit) && touching)
+    {
+        const uint16_t dx = x > last.x ? x - last.x : last.x - x;
+        const uint16_t dy = y > last.y ? y - last.y : last.y - y;
+        const uint32_t distance = dx > dy ? dx + (3 * dy >> 3) : dy + (3 * dx >> 3);
+        journal_path += distance;
+        // The chip scans at most once per active interval (255 is free run), so a shorter gap is only how the reports
+        // were drained. Two reports read in one drain would otherwise make any movement look instantaneous.
+        const uint32_t scan_ms = config_image.t7.actacqint < 255 ? config_image.t7.actacqint : 1;
+        const uint32_t elapsed = now - last.time > scan_ms ? now - last.time : scan_ms;
+        if (elapsed)
+        {
+            const uint32_t speed = distance * 1000 / elapsed;
+            journal_speed = speed > journal_speed ? speed : journal_speed;
+        }
+    }
+    last.x = x;
+    last.y = y;
+    last.time = now;
+
+    journal_contacts |= bit;
+    const uint8_t fingers = std::popcount(journal_contacts);
+    journal_session.fingers = fingers > journal_session.fingers ? fingers : journal_session.fingers;
+    if (!touching)
+    {
+        journal_contacts &= ~bit;
+        if (!journal_contacts)
+        {
+            journal_close(now);
+        }
+    }
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// T100: Touch reports. The first report_id carries the screen status, the second is reserved and   //
+//       each one after that is a contact.                                                          //
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+static void handle_t100_message(const mxt_message &message, uint8_t index, digitizer_t &digitizer)
+{
+    if (index < 2)
+    {
+        // Unused for now, but the first report contains the number of contacts
+        return;
+    }
+
+    const uint8_t contact_id = index - 2;
+    if (contact_id >= NUM_FINGERS)
+    {
+        return;
+    }
+#ifdef MXT_METRICS
+    const uint32_t now = timer_read32();
+    METRIC_COUNT(MXT_COUNTER_CONTACT_REPORTS);
+    METRIC_SAMPLE(MXT_HISTOGRAM_REPORT_GAP, now - metrics_last_report);
+    metrics_last_report = now;
+    metrics_second_reports++;
+#endif
+    int event = (message.data[0] & 0xf);
+    uint16_t x = message.data[1] | (message.data[2] << 8);
+    uint16_t y = message.data[3] | (message.data[4] << 8);
+#ifdef MXT_TRACE_LENGTH
+    trace_record(contact_id, event, x, y);
+#endif
+#ifdef MXT_LINEARITY_GRID
+    linearity_correct(x, y);
+#endif
+#ifdef MXT_JITTER_FILTER
+    jitter_filter(contact_id, event == DOWN || event == DOWNSUP || event == DOWNUP, x, y);
+#endif
+#ifdef MXT_RECALIBRATION
+    recalibration_track(contact_id, event == DOWN || event == DOWNSUP || event == DOWNUP, x, y);
+#endif
+    if (event == DOWN)
+    {
+        digitizer.fingers[contact_id].tip = true;
+    }
+    if (event == UP || event == UNSUP || event == DOWNUP)
+    {
+        digitizer.fingers[contact_id].tip = 0;
+#ifdef MXT_CONTACT_PRESSURE
+        digitizer.fingers[contact_id].pressure = 0;
+        digitizer.fingers[contact_id].pressed = false;
+#endif
+    }
+    digitizer.fingers[contact_id].confidence = !(event == SUP || event == DOWNSUP);
+#ifdef MXT_JOURNAL
+    // A suppressed contact has no tip, but it is still on the sensor
+    const bool suppressed = event == SUP || event == DOWNSUP || event == UNSUPSUP;
+    journal_track(contact_id, event == DOWN || event == DOWNSUP || event == DOWNUP,
+                  digitizer.fingers[contact_id].tip || suppressed, suppressed, x, y);
+#endif
+    if (event != UP)
+    {
+        digitizer.fingers[contact_id].x = x;
+        digitizer.fingers[contact_id].y = y;
+#ifdef MXT_CONTACT_ELLIPSE
+        ellipse_decode(message, digitizer.fingers[contact_id]);
+#endif
+#ifdef MXT_CONTACT_PRESSURE
+        if (digitizer.fingers[contact_id].tip)
+        {
+            pressure_decode(message, digitizer.fingers[contact_id]);
+        }
+#endif
+    }
+}
+
+static void dispatch_message(const mxt_message &message, digitizer_t &digitizer)
+{
+    for (int i = 0; i < num_report_handlers; i++)
+    {
+        const report_handler &handler = report_handlers[i];
+        if (message.report_id >= handler.first_report_id && message.report_id <= handler.last_report_id)
+        {
+            handler.handler(message, message.report_id - handler.first_report_id, digitizer);
+            return;
+        }
+    }
+    METRIC_COUNT(MXT_COUNTER_UNHANDLED_IDS);
+    printf("Unhandled ID: %d\n", message.report_id);
+}
+
+#ifdef MXT_CHG_PIN
+const sleep_stats_t *get_sleep_stats(void)
+{
+    return &sleep_stats;
+}
+
+// Sleep the MCU until CHG goes low. Boards override this with their deep sleep, with CHG as the only wake source.
+__attribute__((weak)) void mxt_wait_for_chg(void)
+{
+    while (readPin(MXT_CHG_PIN))
+    {
+        wait_ms(1);
+    }
+}
+
+// The chip is idle once nothing has touched it for the T7 active to idle timeout
+bool mxt_can_sleep(const digitizer_t &digitizer)
+{
+    for (int i = 0; i < NUM_FINGERS; i++)
+    {
+        if (digitizer.fingers[i].tip)
+        {
+            return false;
+        }
+    }
+    return timer_read32() - last_touch_time >= (uint32_t)config_image.t7.actv2idelto * MXT_T7_TIMEOUT_UNIT_MS;
+}
+
+// Call from the main loop in place of polling, returns straight away unless the sensor is idle
+void mxt_sleep(const digitizer_t &digitizer)
+{
+    if (!mxt_can_sleep(digitizer) || !readPin(MXT_CHG_PIN))
+    {
+        return;
+    }
+    const uint32_t sleep_time = timer_read32();
+    mxt_wait_for_chg();
+    wake_time = timer_read32();
+    woken = true;
+    sleep_stats.sleeps++;
+    sleep_stats.asleep_ms += wake_time - sleep_time;
+}
+
+// Note the first report with a contact after each wake, and keep the idle timer up to date
+static void sleep_track(const digitizer_t &digitizer)
+{
+    for (int i = 0; i < NUM_FINGERS; i++)
+    {
+        if (digitizer.fingers[i].tip)
+        {
+            last_touch_time = timer_read32();
+            if (woken)
+            {
+                const uint32_t latency = last_touch_time - wake_time;
+                sleep_stats.last_latency_ms = latency > 0xFFFF ? 0xFFFF : latency;
+                if (sleep_stats.last_latency_ms > sleep_stats.max_latency_ms)
+                {
+                    sleep_stats.max_latency_ms = sleep_stats.last_latency_ms;
+                }
+                sleep_stats.total_latency_ms += sleep_stats.last_latency_ms;
+                sleep_stats.touch_wakes++;
+                woken = false;
+            }
+            return;
+        }
+    }
+}
+#endif
+
+#ifdef MXT_WAKE_GESTURE
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+// T24/T93: Gestures recognised by the chip. Only a double tap is of interest, to wake the host.    //
+//////////////////////////////////////////////////////////////////////////////////////////////////////
+static void handle_t24_message(const mxt_message &message, [[maybe_unused]] uint8_t index, [[maybe_unused]] digitizer_t &digitizer)
+{
+    if (suspended && (message.data[0] >> T24_MSGTYPE_SHIFT) == T24_MSGTYPE_DOUBLE_TAP)
+    {
+        wake_gesture = true;
+    }
+}
+
+static void handle_t93_message(const mxt_message &message, [[maybe_unused]] uint8_t index, [[maybe_unused]] digitizer_t &digitizer)
+{
+    if (suspended && (message.data[0] & T93_STATUS_DOUBLE_TAP))
+    {
+        wake_gesture = true;
+    }
+}
+
+// Returns true once if a double tap has been seen since the last call
+bool mxt_wake_gesture(void)
+{
+    const bool seen = wake_gesture;
+    wake_gesture = false;
+    return seen;
+}
+
+// Switch to the low power profile: slower acquisition, contact reports off and the chip's gesture recognition on.
+// T100 keeps scanning, so the gesture object still sees the taps.
+void mxt_suspend(void)
+{
+    const uint16_t gesture_address = t93_touch_sequence_address ? t93_touch_sequence_address : t24_gesture_address;
+    if (suspended || !gesture_address || !t7_powerconfig_address || !t100_multiple_touch_touchscreen_address)
+    {
+        return;
+    }
+    suspended = true;
+    wake_gesture = false;
+
+    resume_acqint[0] = config_image.t7.idleacqint;
+    resume_acqint[1] = config_image.t7.actacqint;
+    CONFIG_IMAGE_SET(t7, idleacqint, MXT_SUSPEND_IDLEACQINT);
+    CONFIG_IMAGE_SET(t7, actacqint, MXT_SUSPEND_ACTACQINT);
+    CONFIG_IMAGE_SET(t100, ctrl, config_image.t100.ctrl & ~T100_CTRL_RPTEN);
+    I2C_Write(mxt_address, t7_powerconfig_address, (uint8_t *)&config_image.t7.idleacqint, offsetof(mxt_gen_powerconfig_t7, actv2idelto));
+    I2C_Write(mxt_address, t100_multiple_touch_touchscreen_address, (uint8_t *)&config_image.t100.ctrl, sizeof(config_image.t100.ctrl));
+
+    // The whole gesture object is written, so the chip recognises the double tap with the timing in the image
+    if (t93_touch_sequence_address)
+    {
+        CONFIG_IMAGE_SET(t93, ctrl, T93_CTRL_RPTEN | T93_CTRL_ENABLE);
+        I2C_Write(mxt_address, t93_touch_sequence_address, (uint8_t *)&config_image.t93, sizeof(mxt_proci_touchsequencelogger_t93));
+    }
+    else
+    {
+        CONFIG_IMAGE_SET(t24, ctrl, T24_CTRL_RPTEN | T24_CTRL_ENABLE);
+        I2C_Write(mxt_address, t24_gesture_address, (uint8_t *)&config_image.t24, sizeof(mxt_proci_onetouchgestureprocessor_t24));
+    }
+    config_patched();
+}
+
+void mxt_resume(void)
+{
+    if (!suspended)
+    {
+        return;
+    }
+    suspended = false;
+
+    if (t93_touch_sequence_address)
+    {
+        CONFIG_IMAGE_SET(t93, ctrl, 0);
+        I2C_Write(mxt_address, t93_touch_sequence_address, (uint8_t *)&config_image.t93.ctrl, sizeof(config_image.t93.ctrl));
+    }
+    else
+    {
+        CONFIG_IMAGE_SET(t24, ctrl, 0);
+        I2C_Write(mxt_address, t24_gesture_address, (uint8_t *)&config_image.t24.ctrl, sizeof(config_image.t24.ctrl));
+    }
+
+    CONFIG_IMAGE_SET(t7, idleacqint, resume_acqint[0]);
+    CONFIG_IMAGE_SET(t7, actacqint, resume_acqint[1]);
+    CONFIG_IMAGE_SET(t100, ctrl, config_image.t100.ctrl | T100_CTRL_RPTEN);
+    I2C_Write(mxt_address, t7_powerconfig_address, (uint8_t *)&config_image.t7.idleacqint, offsetof(mxt_gen_powerconfig_t7, actv2idelto));
+    I2C_Write(mxt_address, t100_multiple_touch_touchscreen_address, (uint8_t *)&config_image.t100.ctrl, sizeof(config_image.t100.ctrl));
+    config_patched();
+}
+#endif
+
+#ifdef MXT_REPORT_GATE
+const report_gate_stats_t *get_report_gate_stats(void)
+{
+    return &report_gate_stats;
+}
+
+static uint16_t difference(uint16_t a, uint16_t b)
+{
+    return a > b ? a - b : b - a;
+}
+
+static bool contact_changed(const finger_t &finger, const finger_t &reported)
+{
+    if (finger.tip != reported.tip || finger.confidence != reported.confidence)
+    {
+        return true;
+    }
+    if (!finger.tip)
+    {
+        return false;
+    }
+#ifdef MXT_CONTACT_PRESSURE
+    if (finger.pressed != reported.pressed || difference(finger.pressure, reported.pressure) > MXT_REPORT_PRESSURE_THRESHOLD)
+    {
+        return true;
+    }
+#endif
+#ifdef MXT_CONTACT_ELLIPSE
+    if (difference(finger.width, reported.width) > MXT_REPORT_THRESHOLD ||
+        difference(finger.height, reported.height) > MXT_REPORT_THRESHOLD || finger.azimuth != reported.azimuth)
+    {
+        return true;
+    }
+#endif
+    return difference(finger.x, reported.x) > MXT_REPORT_THRESHOLD || difference(finger.y, reported.y) > MXT_REPORT_THRESHOLD;
+}
+
+// Call when the host is ready for a report. Returns a mask of the contacts which need reporting, one bit per contact,
+// or 0 when the report should be skipped. A non zero result is taken to mean the report is sent.
+uint16_t mxt_report_gate(const digitizer_t &digitizer)
+{
+    report_gate_stats.polls++;
+    uint16_t dirty = 0;
+    [[maybe_unused]] uint16_t touching = 0;
+    for (int i = 0; i < NUM_FINGERS; i++)
+    {
+        if (contact_changed(digitizer.fingers[i], last_report.fingers[i]))
+        {
+            dirty |= 1 << i;
+        }
+        if (digitizer.fingers[i].tip)
+        {
+            touching |= 1 << i;
+        }
+    }
+#ifdef MXT_KEY_ARRAY
+    // Keys don't belong to a contact, a change is reported against all of them
+    const bool keys_changed = digitizer.keys != last_report.keys;
+    if (keys_changed)
+    {
+        dirty |= (1 << NUM_FINGERS) - 1;
+    }
+#endif
+
+    const uint32_t now = timer_read32();
+#if MXT_REPORT_KEEPALIVE_MS
+    if (!dirty && touching && now - last_report_time >= MXT_REPORT_KEEPALIVE_MS)
+    {
+        dirty = touching;
+        report_gate_stats.keepalives++;
+    }
+#endif
+    if (dirty)
+    {
+        // A contact which wasn't reported keeps its last reported state, so small movements add up until they cross
+        // the threshold
+        for (int i = 0; i < NUM_FINGERS; i++)
+        {
+            if (dirty & (1 << i))
+            {
+                last_report.fingers[i] = digitizer.fingers[i];
+            }
+        }
+#ifdef MXT_KEY_ARRAY
+        if (keys_changed)
+        {
+            last_report.keys = digitizer.keys;
+        }
+#endif
+        last_report_time = now;
+        report_gate_stats.reports++;
+        METRIC_COUNT(MXT_COUNTER_HID_REPORTS);
+    }
+    return dirty;
+}
+#endif
+
+#ifdef MXT_METRICS
+static void metrics_drain(uint32_t start, uint8_t messages)
+{
+    const uint32_t now = timer_read32();
+    METRIC_COUNT(MXT_COUNTER_DRAINS);
+    metrics.counters[MXT_COUNTER_MESSAGES] += messages;
+    METRIC_SET(MXT_GAUGE_LAST_DRAIN, messages);
+    if (messages > metrics.gauges[MXT_GAUGE_MAX_DRAIN])
+    {
+        METRIC_SET(MXT_GAUGE_MAX_DRAIN, messages);
+    }
+    METRIC_SAMPLE(MXT_HISTOGRAM_DRAIN_SIZE, messages);
+    METRIC_SAMPLE(MXT_HISTOGRAM_DRAIN_MS, now - start);
+    if (now - metrics_second_start >= 1000)
+    {
+        METRIC_SET(MXT_GAUGE_REPORTS_PER_SECOND, metrics_second_reports);
+        metrics_second_reports = 0;
+        metrics_second_start = now;
+    }
+}
+#endif
+
+// The input digitizer_report is the previous digitizer state, we return a modified state 
+digitizer_t read_messages(digitizer_t digitizer_report)
+{
+    if (t44_message_count_address)
+    {
+        mxt_message_count message_count = {};
+#ifdef MXT_METRICS
+        const uint32_t drain_start = timer_read32();
+#endif
+
+        int status = OK;
+#ifdef MXT_CHG_PIN
+        // CHG is high when the queue is empty, so there is nothing to read
+        if (!readPin(MXT_CHG_PIN))
+#endif
+        {
+            status = I2C_Read(mxt_address, t44_message_count_address, (uint8_t *)&message_count, sizeof(mxt_message_count));
+        }
+        if (status == OK)
+        {
+            for (int i = 0; i < message_count.count; i++)
+            {
+                mxt_message message = {};
+                status = I2C_Read(mxt_address, t5_message_processor_address,
+                                  (uint8_t *)&message, message_read_size);
+                if (status == OK)
+                {
+                    dispatch_message(message, digitizer_report);
+                }
+                else
+                {
+                    METRIC_COUNT(MXT_COUNTER_BUS_ERRORS);
+                }
+            }
+        }
+        else
+        {
+            METRIC_COUNT(MXT_COUNTER_BUS_ERRORS);
+        }
+#ifdef MXT_METRICS
+        metrics_drain(drain_start, message_count.count);
+#endif
+        if (device_config_lost)
+        {
+            // The chip reset and came back without our configuration
+            device_config_lost = false;
+            write_configuration();
+        }
+#ifdef MXT_TOUCH_SUPPRESSION
+        // Applied once the whole frame has been read, so it covers contacts reported before the T42 message too.
+        // Only contacts which are down are affected, a contact which has lifted keeps the confidence it lifted with.
+        if (touch_suppressed)
+        {
+#ifdef MXT_JOURNAL
+            journal_palm |= journal_contacts != 0;
+#endif
+            for (int i = 0; i < NUM_FINGERS; i++)
+            {
+                if (digitizer_report.fingers[i].tip)
+                {
+                    digitizer_report.fingers[i].confidence = false;
+                }
+            }
+        }
+#endif
+#ifdef MXT_SELFTEST
+        selftest_task(digitizer_report);
+#endif
+#ifdef MXT_RECALIBRATION
+        recalibration_task(digitizer_report);
+#endif
+#if defined(MXT_STREAM) || defined(MXT_TUNING)
+        raw_hid_timeout_task();
+#endif
+#ifdef MXT_CHG_PIN
+        sleep_track(digitizer_report);
+#endif
+    }
+    return digitizer_report;
+}
+
+#ifdef MXT_STREAM
+static void stream_send(mxt_raw_hid_stream_packet &packet, uint8_t source, uint8_t length)
+{
+    packet.command = MXT_RAW_HID_STREAM;
+    packet.sequence = stream_sequence++;
+    packet.source = source;
+    packet.length = length;
+    raw_hid_send((uint8_t *)&packet, sizeof(packet));
+    stream_credits--;
+    stream_stats.packets++;
+    stream_stats.bytes += length;
+}
+
+#ifdef MXT_TRACE_LENGTH
+// Send as many whole trace samples as fit in a packet
+static bool stream_trace(void)
+{
+    if (trace_tail == trace_head)
+    {
+        return false;
+    }
+    stream_stats.dropped_samples += trace_dropped;
+    trace_dropped = 0;
+
+    mxt_raw_hid_stream_packet packet = {};
+    uint8_t length = 0;
+    for (; trace_tail != trace_head && length <= sizeof(packet.data) - MXT_TRACE_SAMPLE_SIZE; trace_tail++)
+    {
+        const trace_sample_t &sample = trace_buffer[trace_tail & trace_mask];
+        const uint8_t bytes[MXT_TRACE_SAMPLE_SIZE] = {
+            (uint8_t)sample.time_ms, (uint8_t)(sample.time_ms >> 8), sample.contact, sample.event,
+            (uint8_t)sample.x,       (uint8_t)(sample.x >> 8),       (uint8_t)sample.y, (uint8_t)(sample.y >> 8),
+        };
+        memcpy(packet.data + length, bytes, sizeof(bytes));
+        length += sizeof(bytes);
+    }
+    stream_send(packet, MXT_STREAM_TRACE, length);
+    return true;
+}
+#endif
+
+// Send the next part of the current T37 frame, or fetch the next page. The chip takes a while to fill T37 after each
+// command, so fetching a page is split across calls rather than waiting for it.
+static bool stream_t37(void)
+{
+    if (stream_frame_offset < sizeof(mxt_debug_diagnostic_t37))
+    {
+        mxt_raw_hid_stream_packet packet = {};
+        const uint8_t remaining = sizeof(mxt_debug_diagnostic_t37) - stream_frame_offset;
+        const uint8_t length = remaining < sizeof(packet.data) ? remaining : sizeof(packet.data);
+        memcpy(packet.data, (const uint8_t *)stream_frame + stream_frame_offset, length);
+        stream_send(packet, MXT_STREAM_T37 | (stream_frame_offset ? 0 : MXT_STREAM_FIRST), length);
+        stream_frame_offset += length;
+        return true;
+    }
+    if (!t37_diagnostic_address || !t6_command_processor_address)
+    {
+        return false;
+    }
+
+    if (!stream_t37_requested)
+    {
+        uint8_t command = stream_t37_page ? T6_DIAGNOSTIC_PAGE_UP : T6_DIAGNOSTIC_DELTAS;
+        I2C_Write(mxt_address, t6_command_processor_address + offsetof(mxt_gen_commandprocessor_t6, diagnostic), &command, 1);
+        stream_t37_requested = true;
+        stream_t37_request_time = timer_read32();
+        return false;
+    }
+    if (read_registers(t37_diagnostic_address, (uint8_t *)stream_frame, sizeof(mxt_debug_diagnostic_t37)) != OK ||
+        stream_frame->mode != T6_DIAGNOSTIC_DELTAS || stream_frame->page != stream_t37_page)
+    {
+        if (timer_read32() - stream_t37_request_time >= MXT_STREAM_T37_TIMEOUT_MS)
+        {
+            // Start the sweep again from the first page
+            stream_stats.dropped_frames++;
+            stream_t37_page = 0;
+            stream_t37_requested = false;
+        }
+        return false;
+    }
+
+    const uint16_t nodes = information.matrix_x_size * information.matrix_y_size;
+    const uint8_t pages = (nodes * 2 + sizeof(stream_frame->data) - 1) / sizeof(stream_frame->data);
+    stream_t37_page = stream_t37_page + 1 < pages ? stream_t37_page + 1 : 0;
+    stream_t37_requested = false;
+    stream_frame_offset = 0;
+    return stream_t37();
+}
+
+// Take the T37 frame from the pool. The anti-touch check never runs while T37 is streamed, so when the stream's own
+// budget is short it borrows the check's page, and stream_stop() gives it back.
+static mxt_debug_diagnostic_t37 *stream_frame_acquire(void)
+{
+#ifdef MXT_RECALIBRATION
+    const uint16_t budget = pool_report.subsystems[MXT_POOL_STREAM].budget;
+    if (budget < POOL_ROUND(sizeof(mxt_debug_diagnostic_t37)))
+    {
+        drift_stop();
+        const uint16_t shortfall = POOL_ROUND(sizeof(mxt_debug_diagnostic_t37)) - budget;
+        if (mxt_pool_reassign(MXT_POOL_DRIFT, MXT_POOL_STREAM, shortfall))
+        {
+            stream_loan += shortfall;
+        }
+    }
+#endif
+    return (mxt_debug_diagnostic_t37 *)pool_acquire(MXT_POOL_STREAM, sizeof(mxt_debug_diagnostic_t37));
+}
+
+static void stream_stop(void)
+{
+    stream_sources = 0;
+    stream_frame = nullptr;
+    pool_release(MXT_POOL_STREAM);
+#ifdef MXT_RECALIBRATION
+    if (stream_loan && mxt_pool_reassign(MXT_POOL_STREAM, MXT_POOL_DRIFT, stream_loan))
+    {
+        stream_loan = 0;
+    }
+#endif
+}
+
+const mxt_stream_stats *get_stream_stats(void)
+{
+    return &stream_stats;
+}
+
+// Call from the main loop, after read_messages(). Sends a few packets while the host has credit for them.
+void mxt_stream_task(void)
+{
+    for (int i = 0; i < MXT_STREAM_BURST && stream_sources; i++)
+    {
+        if (!stream_credits)
+        {
+            bool waiting = stream_sources & MXT_STREAM_T37;
+#ifdef MXT_TRACE_LENGTH
+            waiting |= (stream_sources & MXT_STREAM_TRACE) && trace_tail != trace_head;
+#endif
+            if (waiting)
+            {
+                stream_stats.credit_stalls++;
+            }
+            return;
+        }
+        bool sent = false;
+#ifdef MXT_TRACE_LENGTH
+        sent = (stream_sources & MXT_STREAM_TRACE) && stream_trace();
+#endif
+        if (!sent && (stream_sources & MXT_STREAM_T37))
+        {
+            sent = stream_t37();
+        }
+        if (!sent)
+        {
+            return;
+        }
+    }
+}
+#endif
+
+#ifdef MXT_TUNING
+// Find the register a field starts at, checking it lies inside one instance of a configuration object. Returns 0 if
+// it doesn't, register 0 is the information block so no field can start there.
+static uint16_t tune_field_address(uint8_t type, uint8_t instance, uint8_t offset, uint8_t length)
+{
+    for (int i = 0; i < num_objects; i++)
+    {
+        const mxt_object_table_element &object = object_table[i];
+        if (object.type != type)
+        {
+            continue;
+        }
+        const uint16_t instance_size = object.size_minus_one + 1;
+        if (!object_is_config(type) || instance > object.instances_minus_one || !length || offset + length > instance_size)
+        {
+            return 0;
+        }
+        return object_address(&object) + instance * instance_size + offset;
+    }
+    return 0;
+}
+
+// The configuration image is what write_configuration() writes, so fields it holds are patched into it as well.
+// Otherwise the next configuration write, after a chip reset for example, would undo the tuning.
+static void tune_image_patch(const tune_field_t &field)
+{
+    if (field.instance)
+    {
+        return;
+    }
+    for (const auto &e : config_image_objects)
+    {
+        if (e.type == field.type && field.offset < e.image_size)
+        {
+            const uint16_t available = e.image_size - field.offset;
+            config_image_patch(e.image_offset + field.offset, tune_data + field.data_offset,
+                               field.length < available ? field.length : available);
+        }
+    }
+}
+
+static void tune_discard(void)
+{
+    tune_num_fields = 0;
+    tune_data_used = 0;
+    tune_data = nullptr;
+    tune_undo = nullptr;
+    pool_release(MXT_POOL_TUNING);
+}
+
+// Whether a staged field covers any of the registers from address to address + length. No field can lie in the
+// information block, so this is false for registers of an object the chip doesn't have.
+static bool tune_overlaps(const tune_field_t &field, uint16_t address, uint16_t length)
+{
+    return field.address < address + length && address < field.address + field.length;
+}
+
+static uint8_t tune_stage(const mxt_raw_hid_field &packet)
+{
+    const uint16_t address = packet.length <= sizeof(packet.data)
+                                 ? tune_field_address(packet.type, packet.instance, packet.offset, packet.length)
+                                 : 0;
+    // The orientation is tracked by the driver, so T100 cfg1 can only be changed through set_orientation(). The report
+    // layout is fixed at build time by t100_aux_index(), so T100 tchaux can't change under the decoder either.
+    const tune_field_t requested = {address, packet.type, packet.instance, packet.offset, packet.length, 0};
+    if (!address
+        || tune_overlaps(requested, t100_multiple_touch_touchscreen_address + offsetof(mxt_touch_multiscreen_t100, cfg1),
+                         sizeof(mxt_touch_multiscreen_t100::cfg1))
+        || tune_overlaps(requested, t100_multiple_touch_touchscreen_address + offsetof(mxt_touch_multiscreen_t100, tchaux),
+                         sizeof(mxt_touch_multiscreen_t100::tchaux)))
+    {
+        return MXT_TUNE_BAD_FIELD;
+    }
+    if (!tune_data)
+    {
+        tune_data = (uint8_t *)pool_acquire(MXT_POOL_TUNING, 2 * MXT_TUNE_STAGE_SIZE);
+        if (!tune_data)
+        {
+            return MXT_TUNE_NO_MEMORY;
+        }
+        tune_undo = tune_data + MXT_TUNE_STAGE_SIZE;
+    }
+    if (tune_data_used + packet.length > MXT_TUNE_STAGE_SIZE)
+    {
+        return MXT_TUNE_FULL;
+    }
+
+    // A field which carries straight on from the one staged before it, in the same object, joins it so the two go
+    // to the chip in one write
+    tune_field_t *last = tune_num_fields ? &tune_fields[tune_num_fields - 1] : nullptr;
+    if (last && last->type == packet.type && last->instance == packet.instance && last->address + last->length == address)
+    {
+        last->length += packet.length;
+    }
+    else if (tune_num_fields == MXT_TUNE_MAX_FIELDS)
+    {
+        return MXT_TUNE_FULL;
+    }
+    else
+    {
+        tune_field_t &field = tune_fields[tune_num_fields++];
+        field = requested;
+        field.data_offset = tune_data_used;
+    }
+    memcpy(tune_data + tune_data_used, packet.data, packet.length);
+    tune_data_used += packet.length;
+    return MXT_TUNE_OK;
+}
+
+// Put back the fields up to and including last, then T100's ctrl if reports were paused
+static void tune_rollback(int last, const uint8_t *ctrl)
+{
+    for (int j = last; j >= 0; j--)
+    {
+        I2C_Write(mxt_address, tune_fields[j].address, tune_undo + tune_fields[j].data_offset, tune_fields[j].length);
+    }
+    if (ctrl)
+    {
+        I2C_Write(mxt_address, t100_multiple_touch_touchscreen_address, (uint8_t *)ctrl, sizeof(*ctrl));
+    }
+    config_patched();
+}
+
+// Write every staged field, one write per run of adjacent registers. The old values are read first, so if a write
+// fails the runs already written can be put back and the chip is left as it was. The chip keeps scanning between the
+// writes, so when there is more than one T100 reports are paused until the last has landed, and the host never sees
+// a frame from a half applied set. The staged fields are dropped either way.
+static uint8_t tune_commit(uint8_t &written)
+{
+    written = 0;
+    for (int i = 0; i < tune_num_fields; i++)
+    {
+        const tune_field_t &field = tune_fields[i];
+        if (I2C_Read(mxt_address, field.address, tune_undo + field.data_offset, field.length) != OK)
+        {
+            tune_discard();
+            return MXT_TUNE_BUS_ERROR;
+        }
+    }
+
+    // ctrl is the first byte of T100. If it is one of the staged fields, it is written with reports still off and
+    // its staged value goes in last.
+    const uint16_t ctrl_address = t100_multiple_touch_touchscreen_address;
+    uint8_t ctrl = 0;
+    uint8_t *staged_ctrl = nullptr;
+    const bool pause = tune_num_fields > 1 && ctrl_address;
+    if (pause)
+    {
+        if (I2C_Read(mxt_address, ctrl_address, &ctrl, sizeof(ctrl)) != OK)
+        {
+            tune_discard();
+            return MXT_TUNE_BUS_ERROR;
+        }
+        for (int i = 0; i < tune_num_fields; i++)
+        {
+            if (tune_overlaps(tune_fields[i], ctrl_address, sizeof(ctrl)))
+            {
+                staged_ctrl = tune_data + tune_fields[i].data_offset + (ctrl_address - tune_fields[i].address);
+            }
+        }
+        uint8_t paused = ctrl & ~T100_CTRL_RPTEN;
+        if (I2C_Write(mxt_address, ctrl_address, &paused, sizeof(paused)) != OK)
+        {
+            tune_rollback(-1, &ctrl);
+            tune_discard();
+            return MXT_TUNE_BUS_ERROR;
+        }
+    }
+    const uint8_t resumed = staged_ctrl ? *staged_ctrl : ctrl;
+    if (staged_ctrl)
+    {
+        *staged_ctrl &= ~T100_CTRL_RPTEN;
+    }
+
+    for (int i = 0; i < tune_num_fields; i++)
+    {
+        const tune_field_t &field = tune_fields[i];
+        if (I2C_Write(mxt_address, field.address, tune_data + field.data_offset, field.length) != OK)
+        {
+            // The failed write may have landed in part, so it is rolled back too
+            tune_rollback(i, pause ? &ctrl : nullptr);
+            tune_discard();
+            return MXT_TUNE_BUS_ERROR;
+        }
+    }
+    if (staged_ctrl)
+    {
+        *staged_ctrl = resumed;
+    }
+    if (pause && I2C_Write(mxt_address, ctrl_address, (uint8_t *)&resumed, sizeof(resumed)) != OK)
+    {
+        tune_rollback(tune_num_fields - 1, &ctrl);
+        tune_discard();
+        return MXT_TUNE_BUS_ERROR;
+    }
+
+    // The CPI follows a new range, and the tables built from the ranges are rebuilt
+    bool ranges_changed = false;
+    for (int i = 0; i < tune_num_fields; i++)
+    {
+        tune_image_patch(tune_fields[i]);
+        ranges_changed |= tune_overlaps(tune_fields[i], ctrl_address + offsetof(mxt_touch_multiscreen_t100, xrange),
+                                        sizeof(mxt_touch_multiscreen_t100::xrange));
+        ranges_changed |= tune_overlaps(tune_fields[i], ctrl_address + offsetof(mxt_touch_multiscreen_t100, yrange),
+                                        sizeof(mxt_touch_multiscreen_t100::yrange));
+    }
+    if (ranges_changed)
+    {
+        cpi_x = clamp_cpi(SAMPLES_TO_CPI(config_image.t100.xrange, reported_width()));
+        cpi_y = clamp_cpi(SAMPLES_TO_CPI(config_image.t100.yrange, reported_height()));
+        update_range_tables();
+    }
+    config_patched();
+    written = tune_num_fields;
+    tune_discard();
+    return MXT_TUNE_OK;
+}
+
+// Read part of the information block, object table and checksum straight from the chip
+static void tune_read_info(mxt_raw_hid_block &packet)
+{
+    const uint16_t size = sizeof(mxt_information_block) + information.num_objects * sizeof(mxt_object_table_element) +
+                          sizeof(information_crc);
+    packet.length = 0;
+    if (num_objects && packet.offset < size)
+    {
+        const uint16_t remaining = size - packet.offset;
+        const uint8_t length = remaining < sizeof(packet.data) ? remaining : sizeof(packet.data);
+        if (I2C_Read(mxt_address, packet.offset, packet.data, length) == OK)
+        {
+            packet.length = length;
+        }
+    }
+}
+
+// Read part of the configuration, laid out as read_configuration() would, without a buffer for the whole of it. Each
+// chunk is read from whichever objects it covers. A failed read ends the block early.
+static void tune_read_config(mxt_raw_hid_block &packet)
+{
+    uint16_t object_start = 0;
+    packet.length = 0;
+    for (int i = 0; i < num_objects && packet.length < sizeof(packet.data); i++)
+    {
+        const mxt_object_table_element *object = &object_table[i];
+        if (!object_is_config(object->type))
+        {
+            continue;
+        }
+        const uint16_t size = object_size(object);
+        const uint16_t position = packet.offset + packet.length;
+        if (position < object_start + size)
+        {
+            const uint16_t remaining = object_start + size - position;
+            const uint8_t space = sizeof(packet.data) - packet.length;
+            const uint8_t length = remaining < space ? remaining : space;
+            if (I2C_Read(mxt_address, object_address(object) + position - object_start, packet.data + packet.length, length) != OK)
+            {
+                return;
+            }
+            packet.length += length;
+        }
+        object_start += size;
+    }
+}
+#endif
+
+#ifdef MXT_RAW_HID
+#if defined(MXT_STREAM) || defined(MXT_TUNING)
+static void raw_hid_timeout_task(void)
+{
+    if (timer_read32() - raw_hid_last_packet < MXT_RAW_HID_TIMEOUT_MS)
+    {
+        return;
+    }
+#ifdef MXT_STREAM
+    if (stream_sources)
+    {
+        stream_stop();
+    }
+#endif
+#ifdef MXT_TUNING
+    if (tune_data)
+    {
+        tune_discard();
+    }
+#endif
+}
+#endif
+
+#if defined(MXT_METRICS) || defined(MXT_STREAM) || defined(MXT_JOURNAL) || defined(MXT_POOL)
+// Copy part of a block into a reply, the host reads a block by stepping the offset until it has the whole size
+static void raw_hid_read_block(mxt_raw_hid_block &packet, const void *block, uint16_t size)
+{
+    packet.length = 0;
+    if (packet.offset < size)
+    {
+        const uint16_t remaining = size - packet.offset;
+        packet.length = remaining < sizeof(packet.data) ? remaining : sizeof(packet.data);
+        memcpy(packet.data, (const uint8_t *)block + packet.offset, packet.length);
+    }
+}
+#endif
+
+// Call from the keyboard's raw_hid_receive(). Returns false if the packet isn't one of ours, otherwise the reply has
+// been sent.
+bool mxt_raw_hid_receive(uint8_t *data, uint8_t length)
+{
+    if (length != MXT_RAW_HID_SIZE)
+    {
+        return false;
+    }
+    mxt_raw_hid_block &packet = *(mxt_raw_hid_block *)data;
+#if defined(MXT_STREAM) || defined(MXT_TUNING)
+    raw_hid_last_packet = timer_read32();
+#endif
+    switch (packet.command)
+    {
+#ifdef MXT_METRICS
+    case MXT_RAW_HID_READ_METRICS:
+        metrics.uptime_ms = timer_read32();
+        raw_hid_read_block(packet, &metrics, sizeof(metrics));
+        break;
+#endif
+#ifdef MXT_STREAM
+    case MXT_RAW_HID_STREAM_START:
+        stream_stop();
+        stream_sources = data[1];
+        stream_credits = data[2];
+        stream_sequence = 0;
+        stream_stats = {};
+        stream_frame_offset = sizeof(mxt_debug_diagnostic_t37);
+        stream_t37_page = 0;
+        stream_t37_requested = false;
+        // The T37 frame comes out of the pool, if its budget has been given away the reply leaves out MXT_STREAM_T37
+        if (stream_sources & MXT_STREAM_T37)
+        {
+            stream_frame = stream_frame_acquire();
+            stream_sources &= stream_frame ? 0xFF : ~MXT_STREAM_T37;
+        }
+        data[1] = stream_sources;
+        break;
+    case MXT_RAW_HID_STREAM_CREDIT:
+        // Credits arrive continuously while streaming, they aren't acknowledged so they don't use up bandwidth
+        stream_credits += data[1];
+        return true;
+    case MXT_RAW_HID_STREAM_STOP:
+        stream_stop();
+        break;
+    case MXT_RAW_HID_READ_STREAM_STATS:
+        raw_hid_read_block(packet, &stream_stats, sizeof(stream_stats));
+        break;
+#endif
+#ifdef MXT_TUNING
+    case MXT_RAW_HID_READ_INFO:
+        tune_read_info(packet);
+        break;
+    case MXT_RAW_HID_READ_CONFIG:
+        tune_read_config(packet);
+        break;
+    case MXT_RAW_HID_READ_FIELD:
+    {
+        mxt_raw_hid_field &field = *(mxt_raw_hid_field *)data;
+        const uint16_t address = field.length <= sizeof(field.data)
+                                     ? tune_field_address(field.type, field.instance, field.offset, field.length)
+                                     : 0;
+        field.status = !address ? MXT_TUNE_BAD_FIELD
+                       : I2C_Read(mxt_address, address, field.data, field.length) != OK ? MXT_TUNE_BUS_ERROR
+                                                                                        : MXT_TUNE_OK;
+        break;
+    }
+    case MXT_RAW_HID_STAGE_FIELD:
+    {
+        mxt_raw_hid_field &field = *(mxt_raw_hid_field *)data;
+        field.status = tune_stage(field);
+        break;
+    }
+    case MXT_RAW_HID_COMMIT:
+    {
+        mxt_raw_hid_field &field = *(mxt_raw_hid_field *)data;
+        field.status = tune_commit(field.length);
+        break;
+    }
+    case MXT_RAW_HID_DISCARD:
+        tune_discard();
+        data[1] = MXT_TUNE_OK;
+        break;
+    case MXT_RAW_HID_BACKUP:
+    {
+        // The chip reports the new configuration checksum through T6 once the backup has been stored
+        uint8_t backup = T6_BACKUPNV;
+        data[1] = t6_command_processor_address &&
+                          I2C_Write(mxt_address, t6_command_processor_address + offsetof(mxt_gen_commandprocessor_t6, backupnv),
+                                    &backup, sizeof(backup)) == OK
+                      ? MXT_TUNE_OK
+                      : MXT_TUNE_BUS_ERROR;
+        break;
+    }
+#endif
+#ifdef MXT_JOURNAL
+    case MXT_RAW_HID_READ_JOURNAL:
+        raw_hid_read_block(packet, &journal, sizeof(journal));
+        break;
+#endif
+#ifdef MXT_POOL
+    case MXT_RAW_HID_READ_POOL:
+        raw_hid_read_block(packet, &pool_report, sizeof(pool_report));
+        break;
+    case MXT_RAW_HID_POOL_REASSIGN:
+    {
+        mxt_raw_hid_pool_move &move = *(mxt_raw_hid_pool_move *)data;
+        move.status = mxt_pool_reassign(move.from, move.to, move.bytes);
+        break;
+    }
+#endif
+    default:
+        return false;
+    }
+    raw_hid_send(data, length);
+    return true;
+}
+#endif
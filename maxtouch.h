@@ -1,13 +1,13 @@
 #pragma once
 
 #define MXT336UD_ADDRESS (0x4A << 1)
+#define MXT336UD_ALT_ADDRESS (0x4B << 1)
+// When the chip is in bootloader mode it answers on a different address, which depends on the strapped address
+#define MXT336UD_BOOTLOADER_ADDRESS (0x26 << 1)
+#define MXT336UD_ALT_BOOTLOADER_ADDRESS (0x27 << 1)
 #define MXT_REG_INFORMATION_BLOCK (0)
 
 
-// These are peacock specific, they are used for handling CPI calculations.
-#define MXT_SENSOR_WIDTH_MM 156
-#define MXT_SENSOR_HEIGHT_MM 91
-
 typedef struct PACKED {
     unsigned char type;
     unsigned char position_ls_byte;
@@ -27,9 +27,19 @@ typedef struct PACKED {
     unsigned char num_objects;
 } mxt_information_block;
 
+// The bootloader has no register map, reading from it returns a single status byte
+static const unsigned char MXT_BOOT_WAITING_BOOTLOAD_CMD = 0xC0;
+static const unsigned char MXT_BOOT_WAITING_FRAME_DATA = 0x80;
+static const unsigned char MXT_BOOT_APP_CRC_FAIL = 0x40;
+static const unsigned char MXT_BOOT_STATUS_MASK = 0x3F;
+
+// Room for the largest message we decode, a T100 contact with all of its aux data. Only the bytes a message actually
+// uses are read from T5.
+static const unsigned char MXT_MESSAGE_DATA_SIZE = 8;
+
 typedef struct PACKED {
     unsigned char report_id;
-    unsigned char data[5];
+    unsigned char data[MXT_MESSAGE_DATA_SIZE];
 } mxt_message;
 
 typedef struct PACKED {
@@ -53,6 +63,30 @@ typedef struct PACKED {
     unsigned char debugctrl2;
 } mxt_gen_commandprocessor_t6;
 
+// T6 messages carry a status byte, followed by the configuration checksum
+static const unsigned char T6_STATUS_RESET = 0x80;
+static const unsigned char T6_STATUS_OFL = 0x40;
+static const unsigned char T6_STATUS_SIGERR = 0x20;
+static const unsigned char T6_STATUS_CAL = 0x10; // Calibrating
+static const unsigned char T6_STATUS_CFGERR = 0x08;
+static const unsigned char T6_STATUS_COMSERR = 0x04;
+
+// Written to t6.backupnv, stores the running configuration in the chip's non-volatile memory
+static const unsigned char T6_BACKUPNV = 0x55;
+
+// Commands written to t6.diagnostic, selecting the data T37 holds
+static const unsigned char T6_DIAGNOSTIC_PAGE_UP = 0x01;
+static const unsigned char T6_DIAGNOSTIC_PAGE_DOWN = 0x02;
+static const unsigned char T6_DIAGNOSTIC_DELTAS = 0x10;
+static const unsigned char T6_DIAGNOSTIC_REFERENCES = 0x11;
+
+// T37 holds one page of diagnostic data at a time, the page being selected through T6
+typedef struct PACKED {
+    unsigned char mode;
+    unsigned char page;
+    unsigned char data[128];
+} mxt_debug_diagnostic_t37;
+
 typedef struct PACKED {
     unsigned char idleacqint;
     unsigned char actacqint;
@@ -101,6 +135,107 @@ typedef struct PACKED {
     unsigned char cfg;
 } mxt_spt_cteconfig_t46;
 
+typedef struct PACKED {
+    unsigned char ctrl;
+    unsigned char cmd;
+    // Followed by the signal limits for each touch object, these are left at their configured values
+} mxt_spt_selftest_t25;
+
+static const unsigned char T25_CTRL_RPTEN = 0x2;
+static const unsigned char T25_CTRL_ENABLE = 0x1;
+
+// Commands written to t25.cmd, the result messages use the same codes to report a failure
+static const unsigned char T25_CMD_PIN_FAULT = 0x11;
+static const unsigned char T25_CMD_SIGNAL_LIMIT = 0x17;
+
+static const unsigned char T25_RESULT_PIN_FAULT = 0x12;
+static const unsigned char T25_RESULT_SIGNAL_LIMIT = 0x17;
+static const unsigned char T25_RESULT_INVALID = 0xFD;
+static const unsigned char T25_RESULT_PASS = 0xFE;
+
+typedef struct PACKED {
+    unsigned char ctrl;
+    unsigned char xorigin;
+    unsigned char yorigin;
+    unsigned char xsize;
+    unsigned char ysize;
+    unsigned char akscfg;
+    unsigned char blen;
+    unsigned char tchthr;
+    unsigned char tchdi;
+    unsigned char reserved[2];
+} mxt_touch_keyarray_t15;
+
+static const unsigned char T15_CTRL_RPTEN = 0x2;
+static const unsigned char T15_CTRL_ENABLE = 0x1;
+
+typedef struct PACKED {
+    unsigned char ctrl;
+    unsigned char reserved;
+    unsigned char maxapprarea;
+    unsigned char maxtcharea;
+    unsigned char supstrength;
+    unsigned char supextto;
+    unsigned char maxnumtchs;
+    unsigned char shapestrength;
+    unsigned char supdist;
+    unsigned char disthyst;
+    unsigned char maxscrarea;
+    unsigned char cfg;
+    unsigned char reserved2;
+    unsigned char edgesupstrength;
+} mxt_proci_touchsuppression_t42;
+
+static const unsigned char T42_CTRL_RPTEN = 0x2;
+static const unsigned char T42_CTRL_ENABLE = 0x1;
+
+// T42 messages have a single status byte
+static const unsigned char T42_STATUS_TCHSUP = 0x01; // Touches are being suppressed
+
+// T24 one touch gestures and T93 touch sequences recognise taps on the chip. The driver sets their ctrl byte, the
+// gesture timing and distances keep the values the chip was configured with.
+typedef struct PACKED {
+    unsigned char ctrl;
+    unsigned char numgest;
+    unsigned short gesten;
+    unsigned char process;
+    unsigned char tapto;
+    unsigned char flickto;
+    unsigned char dragto;
+    unsigned char spressto;
+    unsigned char lpressto;
+    unsigned char reppressto;
+    unsigned short flickthr;
+    unsigned short dragthr;
+    unsigned short tapthr;
+    unsigned short throwthr;
+} mxt_proci_onetouchgestureprocessor_t24;
+
+typedef struct PACKED {
+    unsigned char ctrl;
+    unsigned char cfg;
+    unsigned char sequence[15]; // The tap timing and distance limits
+} mxt_proci_touchsequencelogger_t93;
+
+static const unsigned char T24_CTRL_RPTEN = 0x2;
+static const unsigned char T24_CTRL_ENABLE = 0x1;
+static const unsigned char T24_MSGTYPE_SHIFT = 4; // The gesture is reported in the top nibble of the status byte
+static const unsigned char T24_MSGTYPE_DOUBLE_TAP = 0x4;
+
+static const unsigned char T93_CTRL_RPTEN = 0x2;
+static const unsigned char T93_CTRL_ENABLE = 0x1;
+static const unsigned char T93_STATUS_DOUBLE_TAP = 0x2;
+
+// T72 noise suppression messages: a status byte, the noise state, then the peak and current noise levels
+static const unsigned char T72_STATUS_FREQCHG = 0x01; // The burst frequency was changed
+static const unsigned char T72_STATE_MASK = 0x07;
+
+enum {
+    T72_STATE_STABLE = 2,
+    T72_STATE_NOISY = 3,
+    T72_STATE_VERY_NOISY = 4
+};
+
 typedef struct PACKED {
     unsigned char ctrl;
     unsigned char cfg1;
@@ -179,6 +314,294 @@ static const unsigned char T100_CFG_DISLOCK = 0x10;
 static const unsigned char T100_CFG_ATCHTHRSEL = 0x8;
 static const unsigned char T100_CFG_RPTEACHCYCLE = 0x1;
 
+// Aux data appended to each contact message, after the position and in this order
+static const unsigned char T100_TCHAUX_VECT = 0x1; // Orientation vector, signed 4-bit X and Y components
+static const unsigned char T100_TCHAUX_AMPL = 0x2; // Signal amplitude
+static const unsigned char T100_TCHAUX_AREA = 0x4; // Contact area in nodes
+
+// Orientations for set_orientation(), a clockwise rotation of the reported axes
+enum {
+    MXT_ROTATE_0,
+    MXT_ROTATE_90,
+    MXT_ROTATE_180,
+    MXT_ROTATE_270
+};
+
+// T100 encodes the line pitch as 5mm plus a number of 0.1mm steps
+static const unsigned short MXT_MIN_PITCH = 50;
+static const unsigned short MXT_MAX_PITCH = MXT_MIN_PITCH + 255;
+// The reported range of each axis is a 16-bit field
+static const unsigned short MXT_MAX_RANGE = 65535;
+
+// Describes a sensor design, all lengths are in 0.1mm units. x_lines and y_lines are the lines actually routed to
+// the sensor, a designer may decide to leave some of the chip's pins unconnected.
+typedef struct {
+    unsigned short width;      // The length of the active area across the X lines
+    unsigned short height;     // The length of the active area across the Y lines
+    unsigned char x_lines;
+    unsigned char y_lines;
+    unsigned char orientation; // T100 cfg1 SWITCHXY/INVERTX/INVERTY bits for how the sensor is mounted
+
+    constexpr unsigned short x_pitch() const { return width / x_lines; }
+    constexpr unsigned short y_pitch() const { return height / y_lines; }
+
+    // The physical lengths of the reported X and Y axes, once the mounting orientation has been applied
+    constexpr unsigned short reported_width() const { return (orientation & T100_CFG_SWITCHXY) ? height : width; }
+    constexpr unsigned short reported_height() const { return (orientation & T100_CFG_SWITCHXY) ? width : height; }
+} mxt_sensor_geometry;
+
+// Describes a block of capacitive keys sharing the matrix with the touchpad, on X and Y lines not used by the sensor.
+// Keys are numbered across each row of X lines, then down the Y lines.
+typedef struct {
+    unsigned char x_origin;
+    unsigned char y_origin;
+    unsigned char x_lines;
+    unsigned char y_lines;
+    unsigned char threshold;
+
+    constexpr unsigned char keys() const { return x_lines * y_lines; }
+} mxt_key_array_geometry;
+
+// Peacock: a 156mm x 91mm sensor on every line of the mXT336UD, mounted with X and Y switched
+static constexpr mxt_sensor_geometry PEACOCK_SENSOR_GEOMETRY = {1560, 910, 24, 14, T100_CFG_SWITCHXY};
+
+// The configuration checksum used by the maXTouch. This is a 24-bit CRC calculated over little endian 16-bit
+// words, when the data has an odd length the last word is padded with a zero byte.
+static const uint32_t MXT_CRC24_POLY = 0x80001B;
+static const uint32_t MXT_CRC24_MASK = 0xFFFFFF;
+
+static constexpr uint32_t mxt_crc24_word(uint32_t crc, uint8_t first_byte, uint8_t second_byte)
+{
+    uint32_t result = (crc << 1) ^ (uint32_t)((second_byte << 8) | first_byte);
+    if (result & (MXT_CRC24_MASK + 1))
+    {
+        result ^= MXT_CRC24_POLY;
+    }
+    return result & MXT_CRC24_MASK;
+}
+
+static constexpr uint32_t mxt_crc24(const uint8_t *data, uint32_t length, uint32_t crc = 0)
+{
+    uint32_t i = 0;
+    for (; i + 1 < length; i += 2)
+    {
+        crc = mxt_crc24_word(crc, data[i], data[i + 1]);
+    }
+    if (i < length)
+    {
+        crc = mxt_crc24_word(crc, data[i], 0);
+    }
+    return crc;
+}
+
+// Multiply two checksums as polynomials modulo the CRC polynomial. Clocking a zero word through the CRC multiplies
+// it by x, so this advances a checksum over a run of zero words without visiting them.
+static constexpr uint32_t mxt_crc24_multiply(uint32_t a, uint32_t b)
+{
+    uint32_t result = 0;
+    for (; b; b >>= 1)
+    {
+        if (b & 1)
+        {
+            result ^= a;
+        }
+        a = mxt_crc24_word(a, 0, 0);
+    }
+    return result;
+}
+
+// Raw HID diagnostics. The channel is the keyboard's vendor raw HID interface, every packet is a fixed 32 bytes and
+// starts with a command byte. Commands are in their own range, so they can share the interface with other protocols.
+static const unsigned char MXT_RAW_HID_SIZE = 32;
+static const unsigned char MXT_RAW_HID_READ_METRICS = 0xA0;
+static const unsigned char MXT_RAW_HID_STREAM_START = 0xA1;  // Followed by the sources to stream and initial credits
+static const unsigned char MXT_RAW_HID_STREAM_CREDIT = 0xA2; // Followed by the number of packets the host can take
+static const unsigned char MXT_RAW_HID_STREAM_STOP = 0xA3;
+static const unsigned char MXT_RAW_HID_STREAM = 0xA4;        // A packet of streamed data, sent by the device
+static const unsigned char MXT_RAW_HID_READ_STREAM_STATS = 0xA5;
+static const unsigned char MXT_RAW_HID_READ_INFO = 0xA6;     // Block: the information block, object table and checksum
+static const unsigned char MXT_RAW_HID_READ_CONFIG = 0xA7;   // Block: every configuration object, as read_configuration()
+static const unsigned char MXT_RAW_HID_READ_FIELD = 0xA8;    // mxt_raw_hid_field, read straight from the chip
+static const unsigned char MXT_RAW_HID_STAGE_FIELD = 0xA9;   // mxt_raw_hid_field, queued until the next commit
+static const unsigned char MXT_RAW_HID_COMMIT = 0xAA;        // Write every staged field, or none of them
+static const unsigned char MXT_RAW_HID_DISCARD = 0xAB;       // Drop the staged fields
+static const unsigned char MXT_RAW_HID_BACKUP = 0xAC;        // Store the running configuration in the chip's NV memory
+static const unsigned char MXT_RAW_HID_READ_POOL = 0xAD;     // Block: the mxt_pool_report
+static const unsigned char MXT_RAW_HID_POOL_REASSIGN = 0xAE; // mxt_raw_hid_pool_move, move budget between subsystems
+static const unsigned char MXT_RAW_HID_READ_JOURNAL = 0xAF;  // Block: the mxt_journal_header and its entries
+
+// A read of part of a block: the host sends the command and offset, the device replies with the same header, the
+// number of bytes it returned and the bytes themselves.
+typedef struct PACKED {
+    unsigned char command;
+    unsigned short offset;
+    unsigned char length;
+    unsigned char data[MXT_RAW_HID_SIZE - 4];
+} mxt_raw_hid_block;
+
+// Live tuning. A field is a run of bytes in one instance of an object, addressed by the object type, the instance
+// and the offset into it. Fields are staged one per packet and applied by a commit: the driver reads back the old
+// values first, writes each run of adjacent fields in one go with T100 reports paused, and if any write fails it puts
+// them all back. T100 cfg1 and tchaux can't be staged, the driver tracks the orientation itself and decodes the
+// auxiliary report bytes with a layout fixed at build time. Every packet is answered with a status, a commit answers
+// with the number of writes it made in length.
+enum {
+    MXT_TUNE_OK,
+    MXT_TUNE_BAD_FIELD, // No such object or instance, the field runs off the end of it, or it isn't configuration the
+                        // host may change
+    MXT_TUNE_FULL,      // The staging buffer has no room for the field
+    MXT_TUNE_BUS_ERROR, // An I2C transfer failed, a commit has been rolled back
+    MXT_TUNE_NO_MEMORY, // The pool has no budget for the staging buffer, see mxt_pool_reassign()
+};
+
+typedef struct PACKED {
+    unsigned char command;
+    unsigned char status;
+    unsigned char type;
+    unsigned char instance;
+    unsigned char offset;
+    unsigned char length;
+    unsigned char data[MXT_RAW_HID_SIZE - 6];
+} mxt_raw_hid_field;
+
+// Streaming. Once started the device sends MXT_RAW_HID_STREAM packets while it has data and credits, each packet
+// costing one credit, so the host paces the stream by how fast it hands credits back. The sequence number counts every
+// packet sent, so a gap shows the host lost packets. Sources which don't fit in one packet are split into frames of
+// several packets, the first marked with MXT_STREAM_FIRST.
+static const unsigned char MXT_STREAM_TRACE = 0x01; // Trace samples, 8 bytes each: time_ms, contact, event, x, y
+static const unsigned char MXT_STREAM_T37 = 0x02;   // T37 delta pages, mode, page and 128 bytes of data
+static const unsigned char MXT_STREAM_FIRST = 0x80;
+static const unsigned char MXT_TRACE_SAMPLE_SIZE = 8;
+
+typedef struct PACKED {
+    unsigned char command;
+    unsigned short sequence;
+    unsigned char source;
+    unsigned char length;
+    unsigned char data[MXT_RAW_HID_SIZE - 5];
+} mxt_raw_hid_stream_packet;
+
+typedef struct PACKED {
+    uint32_t packets;
+    uint32_t bytes;
+    uint32_t dropped_samples; // Trace samples overwritten before they could be sent
+    uint32_t dropped_frames;  // T37 frames skipped because the stream was behind
+    uint32_t credit_stalls;   // Times the stream had data but no credits
+} mxt_stream_stats;
+
+// The buffer pool. Each subsystem has a budget, a region of the pool it allocates its buffer from, and budgets can be
+// moved between subsystems at runtime while the regions involved are free. Sizes are in bytes.
+enum {
+    MXT_POOL_TRACE,  // The trace ring, recorded from every contact report
+    MXT_POOL_DRIFT,  // The T37 page read by the anti-touch check
+    MXT_POOL_STREAM, // The T37 frame being streamed
+    MXT_POOL_TUNING, // Staged tuning fields, and their old values
+    MXT_POOL_SUBSYSTEMS
+};
+
+typedef struct PACKED {
+    unsigned short budget;
+    unsigned short used;
+    unsigned short peak;
+    unsigned short failures; // Requests which didn't fit in the budget
+} mxt_pool_usage;
+
+typedef struct PACKED {
+    unsigned short size;
+    unsigned short used;
+    unsigned short peak; // The most of the pool in use at once
+    unsigned char num_subsystems;
+    unsigned char reserved;
+    mxt_pool_usage subsystems[MXT_POOL_SUBSYSTEMS];
+} mxt_pool_report;
+
+// The device replies with status 1 if the budget moved, 0 if a region involved is busy or the donor is too small
+typedef struct PACKED {
+    unsigned char command;
+    unsigned char status;
+    unsigned char from;
+    unsigned char to;
+    unsigned short bytes;
+} mxt_raw_hid_pool_move;
+
+// The session journal. A session runs from the first contact touching down to the last one lifting, and each one
+// closed is written to a ring of entries following the header. Lengths are in mm, positions being converted with
+// the X axis CPI.
+static const unsigned char MXT_JOURNAL_VERSION = 1;
+
+enum {
+    MXT_SESSION_TAP,            // One finger, barely moving, lifted quickly
+    MXT_SESSION_HOLD,           // One finger, barely moving, held
+    MXT_SESSION_DRAG,           // One finger moving
+    MXT_SESSION_TWO_FINGER_TAP, // Two fingers, barely moving
+    MXT_SESSION_SCROLL,         // Two fingers moving
+    MXT_SESSION_MULTI_FINGER,   // Three or more fingers at once
+    MXT_SESSION_PALM,           // The chip suppressed the touch as a palm at some point
+    MXT_NUM_SESSION_CLASSES
+};
+
+typedef struct PACKED {
+    uint32_t start_ms;
+    uint32_t end_ms;
+    unsigned short path_mm;   // Distance moved, added up over every contact
+    unsigned short max_speed; // The fastest any contact moved between two reports, in mm/s
+    unsigned char fingers;    // The most contacts down at once
+    unsigned char gesture;    // MXT_SESSION_*
+} mxt_journal_entry;
+
+typedef struct PACKED {
+    unsigned char version;
+    unsigned char length; // Entries in the ring
+    unsigned short reserved;
+    uint32_t sessions;    // Sessions closed since boot, the newest is entry (sessions - 1) % length
+} mxt_journal_header;
+
+// The metrics registry. Counters only ever increase, gauges hold the latest value and histograms count samples into
+// power of two buckets: bucket 0 counts zeros, bucket n counts values from 2^(n-1) to 2^n - 1, the last counts the
+// rest. The block is versioned, a host decoding it must check the version and the sizes in the header.
+static const unsigned char MXT_METRICS_VERSION = 1;
+static const unsigned char MXT_HISTOGRAM_BUCKETS = 8;
+
+enum {
+    MXT_COUNTER_DRAINS,          // Calls to read_messages() which read the message count
+    MXT_COUNTER_MESSAGES,        // Messages read
+    MXT_COUNTER_BUS_ERRORS,      // Failed I2C transfers while draining
+    MXT_COUNTER_OVERFLOWS,       // T6 reported the message queue overflowed
+    MXT_COUNTER_RESETS,          // T6 reported the chip reset, the driver must resynchronise
+    MXT_COUNTER_CONFIG_ERRORS,   // T6 reported a configuration error
+    MXT_COUNTER_UNHANDLED_IDS,   // Messages with no handler
+    MXT_COUNTER_CONTACT_REPORTS, // T100 contact messages
+    MXT_COUNTER_HID_REPORTS,     // Reports let through the report gate
+    MXT_NUM_COUNTERS
+};
+
+enum {
+    MXT_GAUGE_LAST_DRAIN,         // Messages in the last drain
+    MXT_GAUGE_MAX_DRAIN,          // The largest drain
+    MXT_GAUGE_REPORTS_PER_SECOND, // Contact messages over the last whole second
+    MXT_NUM_GAUGES
+};
+
+enum {
+    MXT_HISTOGRAM_DRAIN_SIZE,  // Messages per drain
+    MXT_HISTOGRAM_DRAIN_MS,    // Time taken by each drain
+    MXT_HISTOGRAM_REPORT_GAP,  // Time between contact messages, in ms
+    MXT_NUM_HISTOGRAMS
+};
+
+typedef struct PACKED {
+    unsigned char version;
+    unsigned char num_counters;
+    unsigned char num_gauges;
+    unsigned char num_histograms;
+    unsigned char num_buckets;
+    unsigned char reserved[3];
+    uint32_t uptime_ms;
+    uint32_t counters[MXT_NUM_COUNTERS];
+    uint32_t gauges[MXT_NUM_GAUGES];
+    uint32_t histograms[MXT_NUM_HISTOGRAMS][MXT_HISTOGRAM_BUCKETS];
+} mxt_metrics_block;
+
 // Touch events reported in the t100 messages
 enum {
     NO_EVENT,
@@ -0,0 +1,83 @@
+// Read the driver's session journal over raw HID and print it, oldest session first, followed by a summary of how
+// much of the time the touchpad was in use. The firmware needs MXT_JOURNAL and MXT_RAW_HID.
+//
+// Each session is printed as "<start_ms> <duration_ms> <fingers> <path_mm> <max_speed_mm_s> <gesture>". The duty
+// cycle is the time spent touching over the span of the sessions in the journal, the figure to size the idle scan
+// interval against.
+//
+// Build with: c++ -std=c++17 -O2 -o mxt_journal mxt_journal.cpp $(pkg-config --cflags --libs hidapi-hidraw)
+// Usage: mxt_journal [vendor_id product_id]
+
+#include "mxt_raw_hid.h"
+
+static const char *const gesture_names[] = {"tap", "hold", "drag", "two_finger_tap", "scroll", "multi_finger", "palm"};
+static_assert(sizeof(gesture_names) / sizeof(*gesture_names) == MXT_NUM_SESSION_CLASSES, "Name every gesture");
+
+int main(int argc, char **argv)
+{
+    hid_device *device = argc > 2 ? raw_hid_open(strtoul(argv[1], nullptr, 16), strtoul(argv[2], nullptr, 16)) : raw_hid_open();
+    if (!device)
+    {
+        return 1;
+    }
+    std::vector<uint8_t> block;
+    if (!raw_hid_read_block(device, MXT_RAW_HID_READ_JOURNAL, block))
+    {
+        return 1;
+    }
+    hid_close(device);
+
+    if (block.size() < sizeof(mxt_journal_header))
+    {
+        fprintf(stderr, "The device doesn't have the journal enabled\n");
+        return 1;
+    }
+    const mxt_journal_header &header = *(const mxt_journal_header *)block.data();
+    if (header.version != MXT_JOURNAL_VERSION)
+    {
+        fprintf(stderr, "Journal version %d, this tool understands version %d\n", header.version, MXT_JOURNAL_VERSION);
+        return 1;
+    }
+    if (!header.length || block.size() < sizeof(mxt_journal_header) + header.length * sizeof(mxt_journal_entry))
+    {
+        fprintf(stderr, "Journal block is %zu bytes, expected %zu\n", block.size(),
+                sizeof(mxt_journal_header) + header.length * sizeof(mxt_journal_entry));
+        return 1;
+    }
+    const mxt_journal_entry *entries = (const mxt_journal_entry *)(block.data() + sizeof(mxt_journal_header));
+
+    // Once the ring has wrapped the oldest entry is the one the next session will overwrite
+    const uint32_t count = header.sessions < header.length ? header.sessions : header.length;
+    const uint32_t first = header.sessions < header.length ? 0 : header.sessions % header.length;
+    uint64_t touching_ms = 0;
+    uint32_t gestures[MXT_NUM_SESSION_CLASSES] = {};
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const mxt_journal_entry &entry = entries[(first + i) % header.length];
+        const uint32_t duration = entry.end_ms - entry.start_ms;
+        const char *gesture = entry.gesture < MXT_NUM_SESSION_CLASSES ? gesture_names[entry.gesture] : "unknown";
+        printf("%u %u %u %u %u %s\n", entry.start_ms, duration, entry.fingers, entry.path_mm, entry.max_speed, gesture);
+        touching_ms += duration;
+        if (entry.gesture < MXT_NUM_SESSION_CLASSES)
+        {
+            gestures[entry.gesture]++;
+        }
+    }
+
+    printf("# %u sessions since boot, %u in the journal\n", header.sessions, count);
+    if (count)
+    {
+        const mxt_journal_entry &oldest = entries[first];
+        const mxt_journal_entry &newest = entries[(first + count - 1) % header.length];
+        const uint32_t span = newest.end_ms - oldest.start_ms;
+        printf("# touching %llu of %u ms, duty cycle %.1f%%\n", (unsigned long long)touching_ms, span,
+               span ? 100.0 * touching_ms / span : 100.0);
+        printf("#");
+        for (int i = 0; i < MXT_NUM_SESSION_CLASSES; i++)
+        {
+            printf(" %s %u", gesture_names[i], gestures[i]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
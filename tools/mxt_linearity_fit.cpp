@@ -0,0 +1,271 @@
+// Fit a linearity correction grid from straight line swipes. Record the swipes with print_trace() on a board with
+// no correction applied, using a ruler or a jig so every stroke is a straight line, in several directions across
+// the whole pad.
+//
+// Each stroke is fitted with a line, and the distance from every sample to its line is the error at that point.
+// The errors are spread onto the grid nodes with bilinear weights, the same weights the firmware interpolates with,
+// and the fit is repeated on the corrected strokes until it settles. The result is printed as the
+// MXT_LINEARITY_GRID defines for the board's config.
+//
+// Build with: c++ -std=c++17 -O2 -o mxt_linearity_fit mxt_linearity_fit.cpp
+// Usage: mxt_linearity_fit <xrange> <yrange> <grid_x> <grid_y> trace1.txt [trace2.txt ...]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define PACKED __attribute__((packed))
+#include "../maxtouch.h"
+
+static const int ITERATIONS = 50;
+static const double DAMPING = 0.5; // Fraction of each update applied, stops neighbouring nodes fighting
+static const size_t MIN_STROKE_SAMPLES = 10;
+
+typedef struct {
+    double x;
+    double y;
+} point;
+
+typedef std::vector<point> stroke;
+
+typedef struct {
+    int size_x;
+    int size_y;
+    double range_x;
+    double range_y;
+    std::vector<point> nodes; // Offsets, indexed [y * size_x + x]
+} grid;
+
+static bool load_trace(const char *path, std::vector<stroke> &strokes)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return false;
+    }
+
+    std::vector<stroke> open(16);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        int time_ms, contact, event, x, y;
+        if (line.empty() || line[0] == '#' || !(fields >> time_ms >> contact >> event >> x >> y) || contact < 0 ||
+            contact >= (int)open.size())
+        {
+            continue;
+        }
+        stroke &s = open[contact];
+        if (event == DOWN)
+        {
+            s.clear();
+        }
+        if (event == UP || event == DOWNUP)
+        {
+            if (s.size() >= MIN_STROKE_SAMPLES)
+            {
+                strokes.push_back(s);
+            }
+            s.clear();
+            continue;
+        }
+        s.push_back({(double)x, (double)y});
+    }
+    return true;
+}
+
+// The bilinear weights of the four nodes around a point, matching linearity_correct() in the firmware
+static void cell_weights(const grid &g, const point &p, int nodes[4], double weights[4])
+{
+    const double gx = std::clamp(p.x / g.range_x * (g.size_x - 1), 0.0, (double)(g.size_x - 1));
+    const double gy = std::clamp(p.y / g.range_y * (g.size_y - 1), 0.0, (double)(g.size_y - 1));
+    const int cx = std::min((int)gx, g.size_x - 2);
+    const int cy = std::min((int)gy, g.size_y - 2);
+    const double fx = gx - cx, fy = gy - cy;
+    nodes[0] = cy * g.size_x + cx;
+    nodes[1] = nodes[0] + 1;
+    nodes[2] = nodes[0] + g.size_x;
+    nodes[3] = nodes[2] + 1;
+    weights[0] = (1 - fx) * (1 - fy);
+    weights[1] = fx * (1 - fy);
+    weights[2] = (1 - fx) * fy;
+    weights[3] = fx * fy;
+}
+
+static point correct(const grid &g, const point &p)
+{
+    int nodes[4];
+    double weights[4];
+    cell_weights(g, p, nodes, weights);
+    point corrected = p;
+    for (int i = 0; i < 4; i++)
+    {
+        corrected.x += weights[i] * g.nodes[nodes[i]].x;
+        corrected.y += weights[i] * g.nodes[nodes[i]].y;
+    }
+    return corrected;
+}
+
+// Straight lines stay straight under any affine transform, so the swipes say nothing about the affine part of the
+// correction and the fit would wander along it. Remove it, leaving that part to the CPI and orientation settings.
+static void remove_affine(grid &g)
+{
+    // Least squares fit of offset = a + b * x + c * y over the nodes, the node positions are symmetric about
+    // the centre of the grid so the three terms are independent.
+    double mean_x = 0, mean_y = 0, slope_xx = 0, slope_xy = 0, slope_yx = 0, slope_yy = 0, var_x = 0, var_y = 0;
+    for (int y = 0; y < g.size_y; y++)
+    {
+        for (int x = 0; x < g.size_x; x++)
+        {
+            const point &n = g.nodes[y * g.size_x + x];
+            const double u = x - (g.size_x - 1) / 2.0, v = y - (g.size_y - 1) / 2.0;
+            mean_x += n.x / g.nodes.size();
+            mean_y += n.y / g.nodes.size();
+            slope_xx += n.x * u;
+            slope_xy += n.x * v;
+            slope_yx += n.y * u;
+            slope_yy += n.y * v;
+            var_x += u * u;
+            var_y += v * v;
+        }
+    }
+    for (int y = 0; y < g.size_y; y++)
+    {
+        for (int x = 0; x < g.size_x; x++)
+        {
+            point &n = g.nodes[y * g.size_x + x];
+            const double u = x - (g.size_x - 1) / 2.0, v = y - (g.size_y - 1) / 2.0;
+            n.x -= mean_x + slope_xx / var_x * u + slope_xy / var_y * v;
+            n.y -= mean_y + slope_yx / var_x * u + slope_yy / var_y * v;
+        }
+    }
+}
+
+// Total least squares line fit, returns the centroid and the unit normal of the line
+static void fit_line(const stroke &s, point &centroid, point &normal)
+{
+    centroid = {0, 0};
+    for (const point &p : s)
+    {
+        centroid.x += p.x / s.size();
+        centroid.y += p.y / s.size();
+    }
+    double sxx = 0, syy = 0, sxy = 0;
+    for (const point &p : s)
+    {
+        sxx += (p.x - centroid.x) * (p.x - centroid.x);
+        syy += (p.y - centroid.y) * (p.y - centroid.y);
+        sxy += (p.x - centroid.x) * (p.y - centroid.y);
+    }
+    const double angle = 0.5 * std::atan2(2 * sxy, sxx - syy);
+    normal = {-std::sin(angle), std::cos(angle)};
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 6)
+    {
+        fprintf(stderr, "Usage: %s <xrange> <yrange> <grid_x> <grid_y> trace1.txt [trace2.txt ...]\n", argv[0]);
+        return 1;
+    }
+
+    grid g;
+    g.range_x = atof(argv[1]);
+    g.range_y = atof(argv[2]);
+    g.size_x = atoi(argv[3]);
+    g.size_y = atoi(argv[4]);
+    if (g.range_x <= 0 || g.range_y <= 0 || g.size_x < 2 || g.size_y < 2)
+    {
+        fprintf(stderr, "The ranges must be positive, and the grid at least 2x2\n");
+        return 1;
+    }
+    g.nodes.assign(g.size_x * g.size_y, {0, 0});
+
+    std::vector<stroke> strokes;
+    for (int i = 5; i < argc; i++)
+    {
+        if (!load_trace(argv[i], strokes))
+        {
+            return 1;
+        }
+    }
+    if (strokes.empty())
+    {
+        fprintf(stderr, "No strokes in the traces\n");
+        return 1;
+    }
+
+    double rms = 0;
+    for (int iteration = 0; iteration < ITERATIONS; iteration++)
+    {
+        std::vector<point> sum(g.nodes.size(), {0, 0});
+        std::vector<double> weight(g.nodes.size(), 0);
+        double squared_error = 0;
+        size_t samples = 0;
+
+        for (const stroke &raw : strokes)
+        {
+            stroke corrected;
+            for (const point &p : raw)
+            {
+                corrected.push_back(correct(g, p));
+            }
+            point centroid, normal;
+            fit_line(corrected, centroid, normal);
+
+            // Only the error across the line can be seen, strokes in other directions pin down the rest
+            for (size_t i = 0; i < raw.size(); i++)
+            {
+                const point &p = corrected[i];
+                const double distance = (p.x - centroid.x) * normal.x + (p.y - centroid.y) * normal.y;
+                int nodes[4];
+                double weights[4];
+                cell_weights(g, raw[i], nodes, weights);
+                for (int j = 0; j < 4; j++)
+                {
+                    sum[nodes[j]].x -= weights[j] * distance * normal.x;
+                    sum[nodes[j]].y -= weights[j] * distance * normal.y;
+                    weight[nodes[j]] += weights[j];
+                }
+                squared_error += distance * distance;
+                samples++;
+            }
+        }
+
+        for (size_t i = 0; i < g.nodes.size(); i++)
+        {
+            if (weight[i] > 0)
+            {
+                g.nodes[i].x += DAMPING * sum[i].x / weight[i];
+                g.nodes[i].y += DAMPING * sum[i].y / weight[i];
+            }
+        }
+        remove_affine(g);
+        rms = std::sqrt(squared_error / samples);
+    }
+
+    printf("// %zu strokes, residual before the last update %.2f samples RMS\n", strokes.size(), rms);
+    printf("#define MXT_LINEARITY_GRID_X %d\n", g.size_x);
+    printf("#define MXT_LINEARITY_GRID_Y %d\n", g.size_y);
+    printf("#define MXT_LINEARITY_GRID { \\\n");
+    for (int y = 0; y < g.size_y; y++)
+    {
+        printf("    {");
+        for (int x = 0; x < g.size_x; x++)
+        {
+            const point &n = g.nodes[y * g.size_x + x];
+            printf("%s{%d, %d}", x ? ", " : "", (int)std::clamp(std::lround(n.x), -128L, 127L),
+                   (int)std::clamp(std::lround(n.y), -128L, 127L));
+        }
+        printf("}%s \\\n", y + 1 < g.size_y ? "," : "");
+    }
+    printf("}\n");
+    return 0;
+}
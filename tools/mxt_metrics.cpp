@@ -0,0 +1,96 @@
+// Read the driver's metrics registry over raw HID and print it. The firmware needs MXT_METRICS and MXT_RAW_HID, and
+// the keyboard's raw_hid_receive() must pass packets on to mxt_raw_hid_receive().
+//
+// The block is decoded using the sizes in its header, so a newer firmware with more metrics still decodes, the extra
+// ones are printed without names.
+//
+// Build with: c++ -std=c++17 -O2 -o mxt_metrics mxt_metrics.cpp $(pkg-config --cflags --libs hidapi-hidraw)
+// Usage: mxt_metrics [vendor_id product_id]
+
+#include "mxt_raw_hid.h"
+
+static const char *const counter_names[] = {
+    "drains", "messages", "bus_errors", "overflows", "resets", "config_errors", "unhandled_ids", "contact_reports", "hid_reports",
+};
+static const char *const gauge_names[] = {"last_drain", "max_drain", "reports_per_second"};
+static const char *const histogram_names[] = {"drain_size", "drain_ms", "report_gap_ms"};
+static_assert(sizeof(counter_names) / sizeof(*counter_names) == MXT_NUM_COUNTERS, "Name every counter");
+static_assert(sizeof(gauge_names) / sizeof(*gauge_names) == MXT_NUM_GAUGES, "Name every gauge");
+static_assert(sizeof(histogram_names) / sizeof(*histogram_names) == MXT_NUM_HISTOGRAMS, "Name every histogram");
+
+static const char *name(const char *const *names, size_t count, size_t index)
+{
+    return index < count ? names[index] : "unknown";
+}
+
+static uint32_t read_u32(const uint8_t *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+int main(int argc, char **argv)
+{
+    hid_device *device = argc > 2 ? raw_hid_open(strtoul(argv[1], nullptr, 16), strtoul(argv[2], nullptr, 16)) : raw_hid_open();
+    if (!device)
+    {
+        return 1;
+    }
+    std::vector<uint8_t> block;
+    if (!raw_hid_read_block(device, MXT_RAW_HID_READ_METRICS, block))
+    {
+        return 1;
+    }
+    hid_close(device);
+
+    if (block.size() < offsetof(mxt_metrics_block, counters))
+    {
+        fprintf(stderr, "The device doesn't have metrics enabled\n");
+        return 1;
+    }
+    const mxt_metrics_block &header = *(const mxt_metrics_block *)block.data();
+    if (header.version != MXT_METRICS_VERSION)
+    {
+        fprintf(stderr, "Metrics version %d, this tool understands version %d\n", header.version, MXT_METRICS_VERSION);
+        return 1;
+    }
+    const size_t expected = offsetof(mxt_metrics_block, counters) +
+                            4 * (header.num_counters + header.num_gauges + header.num_histograms * header.num_buckets);
+    if (block.size() < expected)
+    {
+        fprintf(stderr, "Metrics block is %zu bytes, expected %zu\n", block.size(), expected);
+        return 1;
+    }
+
+    printf("uptime_ms %u\n", header.uptime_ms);
+    const uint8_t *data = block.data() + offsetof(mxt_metrics_block, counters);
+    for (size_t i = 0; i < header.num_counters; i++, data += 4)
+    {
+        printf("counter %s %u\n", name(counter_names, sizeof(counter_names) / sizeof(*counter_names), i), read_u32(data));
+    }
+    for (size_t i = 0; i < header.num_gauges; i++, data += 4)
+    {
+        printf("gauge %s %u\n", name(gauge_names, sizeof(gauge_names) / sizeof(*gauge_names), i), read_u32(data));
+    }
+    for (size_t i = 0; i < header.num_histograms; i++)
+    {
+        printf("histogram %s", name(histogram_names, sizeof(histogram_names) / sizeof(*histogram_names), i));
+        for (size_t j = 0; j < header.num_buckets; j++, data += 4)
+        {
+            // Bucket 0 counts zeros, bucket n counts values below 2^n, the last is open ended
+            if (j == 0)
+            {
+                printf(" 0:%u", read_u32(data));
+            }
+            else if (j + 1 < header.num_buckets)
+            {
+                printf(" <%u:%u", 1u << j, read_u32(data));
+            }
+            else
+            {
+                printf(" >=%u:%u", 1u << (j - 1), read_u32(data));
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,283 @@
+// Sweep the T100 movement filter parameters (movsmooth, movfilter, movhysti, movhystn) over a corpus of recorded
+// traces, and print the settings on the Pareto front of settle latency against stationary jitter.
+//
+// The traces are captured with print_trace() while the chip's own movement filters are off
+// (set_motion_filter(0, 0, 0, 0)), so they hold unfiltered positions. Each trace is replayed through a model of
+// the T100 filters for every setting:
+//   - hysteresis: the reported position holds until the contact moves movhysti away, then movhystn per step
+//   - smoothing: a recursive filter weighted movsmooth/256 towards the last output, which tails off with speed
+//     at a rate set by movfilter
+// The model is an approximation of the firmware, good for ranking settings. Confirm the chosen point on hardware.
+//
+// For each front point the swept T100 fields are printed as mxt_tune arguments, movfilter and movsmooth then movhysti
+// and movhystn, so movpred between them is left as the board has it. Apply them with set_motion_filter() in firmware,
+// or live with mxt_tune set.
+//
+// Build with: c++ -std=c++20 -O2 -pthread -o mxt_motion_pareto mxt_motion_pareto.cpp
+// Usage: mxt_motion_pareto trace1.txt [trace2.txt ...]
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define PACKED __attribute__((packed))
+#include "../maxtouch.h"
+
+static const int SETTLE_DISTANCE = 2;        // Output is settled once it is this close to the contact
+static const int STATIONARY_DISTANCE = 3;    // Input moving less than this per frame counts as stationary
+static const int STATIONARY_FRAMES = 5;      // Frames of stillness before jitter is measured
+
+typedef struct {
+    int time_ms;
+    int x;
+    int y;
+} sample;
+
+typedef struct {
+    uint8_t movsmooth;
+    uint8_t movfilter;
+    uint16_t movhysti;
+    uint16_t movhystn;
+} setting;
+
+typedef struct {
+    setting filter;
+    double settle_ms;
+    double jitter;
+} result;
+
+// One continuous stroke, from DOWN to UP for a single contact
+typedef std::vector<sample> stroke;
+
+static bool load_trace(const char *path, std::vector<stroke> &strokes)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return false;
+    }
+
+    std::vector<stroke> open(16);
+    int last_time = -1, time_base = 0;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        int time_ms, contact, event, x, y;
+        if (line.empty() || line[0] == '#' || !(fields >> time_ms >> contact >> event >> x >> y) || contact < 0 ||
+            contact >= (int)open.size())
+        {
+            continue;
+        }
+        // The device only records the low 16 bits of its timer
+        if (last_time >= 0 && time_ms < last_time)
+        {
+            time_base += 0x10000;
+        }
+        last_time = time_ms;
+
+        stroke &s = open[contact];
+        if (event == DOWN)
+        {
+            s.clear();
+        }
+        if (event != UP && event != DOWNUP)
+        {
+            s.push_back({time_base + time_ms, x, y});
+        }
+        if ((event == UP || event == DOWNUP || event == UNSUP) && !s.empty())
+        {
+            strokes.push_back(s);
+            s.clear();
+        }
+    }
+    return true;
+}
+
+// Replay a stroke through the filter model, returning the reported positions
+static stroke filter_stroke(const stroke &input, const setting &f)
+{
+    stroke output;
+    double out_x = input[0].x, out_y = input[0].y;
+    int held_x = input[0].x, held_y = input[0].y;
+    bool moving = false;
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        // Hysteresis
+        const int hysteresis = moving ? f.movhystn : f.movhysti;
+        int in_x = held_x, in_y = held_y;
+        if (std::abs(input[i].x - held_x) > hysteresis || std::abs(input[i].y - held_y) > hysteresis)
+        {
+            in_x = held_x = input[i].x;
+            in_y = held_y = input[i].y;
+            moving = true;
+        }
+
+        // Smoothing, weighted towards the last output less as the speed increases
+        const double speed = std::hypot(in_x - out_x, in_y - out_y);
+        const double weight = f.movsmooth / 256.0 * 16.0 / (16.0 + f.movfilter * speed);
+        out_x = weight * out_x + (1.0 - weight) * in_x;
+        out_y = weight * out_y + (1.0 - weight) * in_y;
+        output.push_back({input[i].time_ms, (int)std::lround(out_x), (int)std::lround(out_y)});
+    }
+    return output;
+}
+
+static result evaluate(const std::vector<stroke> &strokes, const setting &f)
+{
+    double settle_total = 0, jitter_total = 0;
+    int settle_count = 0, jitter_count = 0;
+    for (const stroke &input : strokes)
+    {
+        const stroke output = filter_stroke(input, f);
+        // A stop the output never catches up with is charged the whole stroke, so a setting can't rank well by
+        // holding the pointer short of where the finger stopped
+        const int stroke_ms = input.back().time_ms - input.front().time_ms;
+        int still = 0;
+        int stop_time = -1;
+        for (size_t i = 1; i <= input.size(); i++)
+        {
+            const bool input_still = i < input.size() && std::abs(input[i].x - input[i - 1].x) < STATIONARY_DISTANCE &&
+                                     std::abs(input[i].y - input[i - 1].y) < STATIONARY_DISTANCE;
+            if (!input_still)
+            {
+                if (stop_time >= 0 && still > STATIONARY_FRAMES)
+                {
+                    settle_total += stroke_ms;
+                    settle_count++;
+                }
+                still = 0;
+                stop_time = -1;
+                continue;
+            }
+            if (still++ == 0)
+            {
+                stop_time = input[i].time_ms;
+            }
+
+            // Latency: from the contact stopping until the output catches up with it
+            if (stop_time >= 0 && std::abs(output[i].x - input[i].x) <= SETTLE_DISTANCE &&
+                std::abs(output[i].y - input[i].y) <= SETTLE_DISTANCE)
+            {
+                settle_total += input[i].time_ms - stop_time;
+                settle_count++;
+                stop_time = -1;
+            }
+
+            // Jitter: how much the output moves while the contact is held still
+            if (still > STATIONARY_FRAMES)
+            {
+                jitter_total += std::hypot(output[i].x - output[i - 1].x, output[i].y - output[i - 1].y);
+                jitter_count++;
+            }
+        }
+    }
+    return {f, settle_count ? settle_total / settle_count : 0, jitter_count ? jitter_total / jitter_count : 0};
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s trace1.txt [trace2.txt ...]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<stroke> strokes;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!load_trace(argv[i], strokes))
+        {
+            return 1;
+        }
+    }
+    if (strokes.empty())
+    {
+        fprintf(stderr, "No strokes in the traces\n");
+        return 1;
+    }
+
+    std::vector<setting> settings;
+    for (int movsmooth = 0; movsmooth <= 256; movsmooth += 32)
+    {
+        for (int movfilter = 0; movfilter < 16; movfilter++)
+        {
+            for (int movhysti = 0; movhysti <= 16; movhysti += 2)
+            {
+                for (int movhystn = 0; movhystn <= 12; movhystn += 2)
+                {
+                    settings.push_back({(uint8_t)std::min(movsmooth, 255), (uint8_t)movfilter, (uint16_t)movhysti, (uint16_t)movhystn});
+                }
+            }
+        }
+    }
+
+    // Each setting is independent, so share them out across every core
+    std::vector<result> results(settings.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    const unsigned num_workers = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < num_workers; i++)
+    {
+        workers.emplace_back([&]() {
+            for (size_t j = next++; j < settings.size(); j = next++)
+            {
+                results[j] = evaluate(strokes, settings[j]);
+            }
+        });
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    // A setting is on the front if nothing else is at least as good on both measures and better on one
+    std::sort(results.begin(), results.end(), [](const result &a, const result &b) {
+        return a.settle_ms < b.settle_ms || (a.settle_ms == b.settle_ms && a.jitter < b.jitter);
+    });
+    std::vector<result> front;
+    for (const result &r : results)
+    {
+        if (front.empty() || r.jitter < front.back().jitter)
+        {
+            front.push_back(r);
+        }
+    }
+
+    // The swept fields sit in two runs, either side of movpred
+    const size_t runs[][2] = {
+        {offsetof(mxt_touch_multiscreen_t100, movfilter), offsetof(mxt_touch_multiscreen_t100, movpred)},
+        {offsetof(mxt_touch_multiscreen_t100, movhysti), offsetof(mxt_touch_multiscreen_t100, amplhyst)},
+    };
+    printf("# %zu strokes, %zu settings, %zu on the front\n", strokes.size(), settings.size(), front.size());
+    printf("# settle_ms jitter movsmooth movfilter movhysti movhystn | mxt_tune fields\n");
+    for (const result &r : front)
+    {
+        mxt_touch_multiscreen_t100 t100 = {};
+        t100.movsmooth = r.filter.movsmooth;
+        t100.movfilter = r.filter.movfilter;
+        t100.movhysti = r.filter.movhysti;
+        t100.movhystn = r.filter.movhystn;
+        printf("%.1f %.3f %d %d %d %d |", r.settle_ms, r.jitter, r.filter.movsmooth, r.filter.movfilter,
+               r.filter.movhysti, r.filter.movhystn);
+        for (const auto &run : runs)
+        {
+            printf(" 100:0:%zu=", run[0]);
+            for (size_t i = run[0]; i < run[1]; i++)
+            {
+                printf("%s%u", i == run[0] ? "" : ",", ((const uint8_t *)&t100)[i]);
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Print the driver's buffer pool report over raw HID, or move budget from one subsystem to another. The firmware needs
+// MXT_RAW_HID and at least one feature which uses the pool (MXT_TRACE_LENGTH, MXT_RECALIBRATION, MXT_STREAM or
+// MXT_TUNING).
+//
+// A move fails while a buffer it would shift is in use, stop the stream or let the drift check finish and try again.
+// The trace ring is always given up, dropping what it held.
+//
+//   mxt_pool                      print the budgets, use and peaks
+//   mxt_pool move trace stream 256
+//
+// Build with: c++ -std=c++17 -O2 -o mxt_pool mxt_pool.cpp $(pkg-config --cflags --libs hidapi-hidraw)
+// Usage: mxt_pool [move <from> <to> <bytes>] [vendor_id product_id]
+
+#include <cstddef>
+#include <string>
+#include "mxt_raw_hid.h"
+
+static const char *const subsystem_names[] = {"trace", "drift", "stream", "tuning"};
+static_assert(sizeof(subsystem_names) / sizeof(*subsystem_names) == MXT_POOL_SUBSYSTEMS, "Name every subsystem");
+
+static int subsystem(const char *name)
+{
+    for (int i = 0; i < MXT_POOL_SUBSYSTEMS; i++)
+    {
+        if (name == std::string(subsystem_names[i]))
+        {
+            return i;
+        }
+    }
+    fprintf(stderr, "Unknown subsystem %s\n", name);
+    return -1;
+}
+
+static int move(hid_device *device, const char *from, const char *to, const char *bytes)
+{
+    mxt_raw_hid_pool_move request = {};
+    mxt_raw_hid_pool_move reply = {};
+    const int from_index = subsystem(from);
+    const int to_index = subsystem(to);
+    if (from_index < 0 || to_index < 0)
+    {
+        return 1;
+    }
+    request.command = MXT_RAW_HID_POOL_REASSIGN;
+    request.from = from_index;
+    request.to = to_index;
+    request.bytes = atoi(bytes);
+    if (!raw_hid_transfer(device, (const uint8_t *)&request, (uint8_t *)&reply))
+    {
+        return 1;
+    }
+    if (!reply.status)
+    {
+        fprintf(stderr, "Couldn't move %u bytes from %s to %s\n", (unsigned)request.bytes, from, to);
+        return 1;
+    }
+    return 0;
+}
+
+static int report(hid_device *device)
+{
+    std::vector<uint8_t> block;
+    if (!raw_hid_read_block(device, MXT_RAW_HID_READ_POOL, block))
+    {
+        return 1;
+    }
+    if (block.size() < offsetof(mxt_pool_report, subsystems))
+    {
+        fprintf(stderr, "The device doesn't have a pool\n");
+        return 1;
+    }
+    const mxt_pool_report &pool = *(const mxt_pool_report *)block.data();
+    printf("pool %u bytes, %u used, %u peak\n", pool.size, pool.used, pool.peak);
+    const mxt_pool_usage *usage = (const mxt_pool_usage *)(block.data() + offsetof(mxt_pool_report, subsystems));
+    for (size_t i = 0; i < pool.num_subsystems && offsetof(mxt_pool_report, subsystems) + (i + 1) * sizeof(mxt_pool_usage) <= block.size(); i++)
+    {
+        printf("%-8s budget %5u used %5u peak %5u failures %u\n", i < MXT_POOL_SUBSYSTEMS ? subsystem_names[i] : "unknown",
+               usage[i].budget, usage[i].used, usage[i].peak, usage[i].failures);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const bool moving = argc > 4 && std::string(argv[1]) == "move";
+    const int ids = moving ? 5 : 1;
+    hid_device *device = argc > ids + 1 ? raw_hid_open(strtoul(argv[ids], nullptr, 16), strtoul(argv[ids + 1], nullptr, 16)) : raw_hid_open();
+    if (!device)
+    {
+        return 1;
+    }
+    const int result = moving ? move(device, argv[2], argv[3], argv[4]) : report(device);
+    hid_close(device);
+    return result;
+}
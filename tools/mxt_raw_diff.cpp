@@ -0,0 +1,127 @@
+// Compare two maXTouch .raw configuration files, for example a dump captured from the console with
+// print_configuration() against the config a board is expected to run. Each differing byte is printed as
+//   T<type>.<instance>[<offset>]: <first> -> <second>
+// and the exit status is the number of differences (capped at 255).
+//
+// Build with: c++ -std=c++17 -o mxt_raw_diff mxt_raw_diff.cpp
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef std::pair<unsigned, unsigned> object_key; // type, instance
+
+struct raw_config {
+    std::string id;
+    std::string info_crc;
+    std::string config_crc;
+    std::map<object_key, std::vector<unsigned>> objects;
+};
+
+static bool load_raw(const char *path, raw_config &config)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return false;
+    }
+
+    // Skip anything before the header, so a raw capture of the console can be used directly
+    std::string line;
+    while (std::getline(file, line) && line.rfind("OBP_RAW V1", 0) != 0)
+    {
+    }
+    if (!file || !std::getline(file, config.id) || !std::getline(file, config.info_crc) ||
+        !std::getline(file, config.config_crc))
+    {
+        fprintf(stderr, "%s is not a .raw config file\n", path);
+        return false;
+    }
+
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        unsigned type, instance, size;
+        if (!(fields >> std::hex >> type >> instance >> size))
+        {
+            break;
+        }
+        std::vector<unsigned> &data = config.objects[object_key(type, instance)];
+        unsigned value;
+        while (data.size() < size && fields >> std::hex >> value)
+        {
+            data.push_back(value);
+        }
+        if (data.size() != size)
+        {
+            fprintf(stderr, "%s: T%u.%u has %zu bytes, expected %u\n", path, type, instance, data.size(), size);
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "Usage: %s <first.raw> <second.raw>\n", argv[0]);
+        return 255;
+    }
+
+    raw_config first, second;
+    if (!load_raw(argv[1], first) || !load_raw(argv[2], second))
+    {
+        return 255;
+    }
+
+    if (first.id != second.id)
+    {
+        printf("Device: %s -> %s\n", first.id.c_str(), second.id.c_str());
+    }
+    if (first.config_crc != second.config_crc)
+    {
+        printf("Config CRC: %s -> %s\n", first.config_crc.c_str(), second.config_crc.c_str());
+    }
+
+    int differences = 0;
+    for (const auto &object : first.objects)
+    {
+        const auto other = second.objects.find(object.first);
+        if (other == second.objects.end())
+        {
+            printf("T%u.%u: only in %s\n", object.first.first, object.first.second, argv[1]);
+            differences++;
+            continue;
+        }
+        const std::vector<unsigned> &a = object.second;
+        const std::vector<unsigned> &b = other->second;
+        for (size_t i = 0; i < a.size() || i < b.size(); i++)
+        {
+            if (i >= a.size() || i >= b.size() || a[i] != b[i])
+            {
+                printf("T%u.%u[%zu]: ", object.first.first, object.first.second, i);
+                printf(i < a.size() ? "%02X" : "--", i < a.size() ? a[i] : 0);
+                printf(" -> ");
+                printf(i < b.size() ? "%02X\n" : "--\n", i < b.size() ? b[i] : 0);
+                differences++;
+            }
+        }
+    }
+    for (const auto &object : second.objects)
+    {
+        if (first.objects.find(object.first) == first.objects.end())
+        {
+            printf("T%u.%u: only in %s\n", object.first.first, object.first.second, argv[2]);
+            differences++;
+        }
+    }
+
+    printf("%d differences\n", differences);
+    return differences > 255 ? 255 : differences;
+}
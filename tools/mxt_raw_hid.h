@@ -0,0 +1,96 @@
+// Shared raw HID helpers for the host tools which talk to the driver over the keyboard's raw HID interface, see
+// mxt_raw_hid_receive() in maxtouch.c. Uses hidapi.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <hidapi/hidapi.h>
+
+#define PACKED __attribute__((packed))
+#include "../maxtouch.h"
+
+// The usage page and usage of the QMK raw HID interface
+static const unsigned short RAW_HID_USAGE_PAGE = 0xFF60;
+static const unsigned short RAW_HID_USAGE = 0x61;
+static const int RAW_HID_TIMEOUT_MS = 1000;
+
+// Open the first raw HID interface, optionally limited to one vendor and product id
+static hid_device *raw_hid_open(unsigned short vendor_id = 0, unsigned short product_id = 0)
+{
+    if (hid_init() != 0)
+    {
+        fprintf(stderr, "Can't initialise hidapi\n");
+        return nullptr;
+    }
+    hid_device *device = nullptr;
+    hid_device_info *devices = hid_enumerate(vendor_id, product_id);
+    for (hid_device_info *info = devices; info && !device; info = info->next)
+    {
+        if (info->usage_page == RAW_HID_USAGE_PAGE && info->usage == RAW_HID_USAGE)
+        {
+            device = hid_open_path(info->path);
+        }
+    }
+    hid_free_enumeration(devices);
+    if (!device)
+    {
+        fprintf(stderr, "No raw HID interface found\n");
+    }
+    return device;
+}
+
+// Send one packet and wait for the reply to the same command, skipping anything else on the interface
+static bool raw_hid_transfer(hid_device *device, const uint8_t *request, uint8_t *reply)
+{
+    uint8_t report[MXT_RAW_HID_SIZE + 1] = {0}; // hidapi wants the report id first, raw HID doesn't use one
+    memcpy(report + 1, request, MXT_RAW_HID_SIZE);
+    if (hid_write(device, report, sizeof(report)) < 0)
+    {
+        fprintf(stderr, "Write failed: %ls\n", hid_error(device));
+        return false;
+    }
+    for (;;)
+    {
+        const int length = hid_read_timeout(device, reply, MXT_RAW_HID_SIZE, RAW_HID_TIMEOUT_MS);
+        if (length <= 0)
+        {
+            fprintf(stderr, "No reply to command %02X\n", request[0]);
+            return false;
+        }
+        if (reply[0] == request[0])
+        {
+            return true;
+        }
+    }
+}
+
+// Read a whole block with repeated reads of MXT_RAW_HID_SIZE - 4 bytes, until the device returns a short chunk
+static bool raw_hid_read_block(hid_device *device, uint8_t command, std::vector<uint8_t> &block)
+{
+    block.clear();
+    for (;;)
+    {
+        mxt_raw_hid_block request = {};
+        mxt_raw_hid_block reply = {};
+        request.command = command;
+        request.offset = block.size();
+        if (!raw_hid_transfer(device, (const uint8_t *)&request, (uint8_t *)&reply))
+        {
+            return false;
+        }
+        if (reply.offset != request.offset || reply.length > sizeof(reply.data))
+        {
+            fprintf(stderr, "Bad reply at offset %u\n", (unsigned)request.offset);
+            return false;
+        }
+        block.insert(block.end(), reply.data, reply.data + reply.length);
+        if (reply.length < sizeof(reply.data))
+        {
+            return true;
+        }
+    }
+}
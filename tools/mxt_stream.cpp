@@ -0,0 +1,143 @@
+// Stream the trace ring and T37 delta pages live from the driver over raw HID. The firmware needs MXT_STREAM and
+// MXT_RAW_HID, with MXT_TRACE_LENGTH for traces, and must call mxt_stream_task() from its main loop.
+//
+// Trace samples are printed in the same "<time_ms> <contact> <event> <x> <y>" format as print_trace(), so a capture
+// can be fed straight to the other tools. T37 pages are printed as "# t37 <page> <delta> ..." lines, which they skip.
+// Once a second the throughput and any lost packets are reported on stderr, and when the capture ends the device's own
+// count of dropped samples and frames. Credit is handed back at least once a second, the device stops streaming if it
+// hears nothing from the host for MXT_RAW_HID_TIMEOUT_MS.
+//
+// Build with: c++ -std=c++17 -O2 -o mxt_stream mxt_stream.cpp $(pkg-config --cflags --libs hidapi-hidraw)
+// Usage: mxt_stream <trace|t37|both> <seconds> [vendor_id product_id]
+
+#include <chrono>
+#include <string>
+#include "mxt_raw_hid.h"
+
+static const int WINDOW = 64;        // Packets the host is prepared to buffer
+static const int CREDIT_BATCH = 16;  // Credits are handed back in batches, to keep the host to device traffic low
+
+static bool send_command(hid_device *device, uint8_t command, uint8_t arg1 = 0, uint8_t arg2 = 0)
+{
+    uint8_t report[MXT_RAW_HID_SIZE + 1] = {0, command, arg1, arg2};
+    return hid_write(device, report, sizeof(report)) >= 0;
+}
+
+static void print_trace(const mxt_raw_hid_stream_packet &packet)
+{
+    for (int i = 0; i + MXT_TRACE_SAMPLE_SIZE <= packet.length; i += MXT_TRACE_SAMPLE_SIZE)
+    {
+        const uint8_t *s = packet.data + i;
+        printf("%u %u %u %u %u\n", s[0] | (s[1] << 8), s[2], s[3], s[4] | (s[5] << 8), s[6] | (s[7] << 8));
+    }
+}
+
+static void print_t37(const std::vector<uint8_t> &frame)
+{
+    if (frame.size() != sizeof(mxt_debug_diagnostic_t37))
+    {
+        return;
+    }
+    printf("# t37 %u", frame[1]);
+    for (size_t i = 2; i + 1 < frame.size(); i += 2)
+    {
+        printf(" %d", (int16_t)(frame[i] | (frame[i + 1] << 8)));
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <trace|t37|both> <seconds> [vendor_id product_id]\n", argv[0]);
+        return 1;
+    }
+    const std::string mode = argv[1];
+    const uint8_t sources = mode == "trace" ? MXT_STREAM_TRACE : mode == "t37" ? MXT_STREAM_T37 : MXT_STREAM_TRACE | MXT_STREAM_T37;
+    const int seconds = atoi(argv[2]);
+    hid_device *device = argc > 4 ? raw_hid_open(strtoul(argv[3], nullptr, 16), strtoul(argv[4], nullptr, 16)) : raw_hid_open();
+    if (!device || !send_command(device, MXT_RAW_HID_STREAM_START, sources, WINDOW))
+    {
+        return 1;
+    }
+
+    using clock = std::chrono::steady_clock;
+    const clock::time_point start = clock::now();
+    clock::time_point second = start;
+    uint64_t total_bytes = 0, second_bytes = 0, lost = 0;
+    int expected_sequence = -1, returned = 0;
+    std::vector<uint8_t> frame;
+    while (clock::now() - start < std::chrono::seconds(seconds))
+    {
+        mxt_raw_hid_stream_packet packet = {};
+        const int length = hid_read_timeout(device, (uint8_t *)&packet, sizeof(packet), 100);
+        if (length > 1 && packet.command == MXT_RAW_HID_STREAM_START && (sources & ~((const uint8_t *)&packet)[1] & MXT_STREAM_T37))
+        {
+            fprintf(stderr, "# the device has no pool budget for T37 frames, move some over with mxt_pool\n");
+        }
+        if (length == (int)sizeof(packet) && packet.command == MXT_RAW_HID_STREAM)
+        {
+            if (expected_sequence >= 0 && packet.sequence != expected_sequence)
+            {
+                // The lost packets used up credits too, hand them back or the window shrinks
+                const uint16_t gap = packet.sequence - expected_sequence;
+                lost += gap;
+                returned += gap;
+                frame.clear(); // The frame in progress is missing a piece
+            }
+            expected_sequence = (uint16_t)(packet.sequence + 1);
+            total_bytes += sizeof(packet);
+            second_bytes += sizeof(packet);
+
+            if ((packet.source & ~MXT_STREAM_FIRST) == MXT_STREAM_TRACE)
+            {
+                print_trace(packet);
+            }
+            else if ((packet.source & ~MXT_STREAM_FIRST) == MXT_STREAM_T37)
+            {
+                if (packet.source & MXT_STREAM_FIRST)
+                {
+                    frame.clear();
+                }
+                frame.insert(frame.end(), packet.data, packet.data + packet.length);
+                if (frame.size() == sizeof(mxt_debug_diagnostic_t37))
+                {
+                    print_t37(frame);
+                    frame.clear();
+                }
+            }
+            if (++returned >= CREDIT_BATCH)
+            {
+                const int credits = returned < WINDOW ? returned : WINDOW;
+                send_command(device, MXT_RAW_HID_STREAM_CREDIT, credits);
+                returned = 0;
+            }
+        }
+
+        const clock::time_point now = clock::now();
+        if (now - second >= std::chrono::seconds(1))
+        {
+            // Whatever credit has built up goes back every second, even none, so the device knows we are still here
+            send_command(device, MXT_RAW_HID_STREAM_CREDIT, returned);
+            returned = 0;
+            const double elapsed = std::chrono::duration<double>(now - second).count();
+            fprintf(stderr, "# %.3f MB/s, %llu packets lost\n", second_bytes / elapsed / 1e6, (unsigned long long)lost);
+            second = now;
+            second_bytes = 0;
+        }
+    }
+
+    send_command(device, MXT_RAW_HID_STREAM_STOP);
+    std::vector<uint8_t> block;
+    const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    fprintf(stderr, "# %.3f MB/s average, %llu packets lost\n", total_bytes / elapsed / 1e6, (unsigned long long)lost);
+    if (raw_hid_read_block(device, MXT_RAW_HID_READ_STREAM_STATS, block) && block.size() >= sizeof(mxt_stream_stats))
+    {
+        const mxt_stream_stats &stats = *(const mxt_stream_stats *)block.data();
+        fprintf(stderr, "# device: %u packets, %u payload bytes, %u samples dropped, %u frames dropped, %u credit stalls\n",
+                stats.packets, stats.bytes, stats.dropped_samples, stats.dropped_frames, stats.credit_stalls);
+    }
+    hid_close(device);
+    return 0;
+}
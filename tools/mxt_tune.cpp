@@ -0,0 +1,273 @@
+// Read and write the maXTouch configuration live over raw HID, without reflashing. The firmware needs MXT_TUNING and
+// MXT_RAW_HID, and the keyboard's raw_hid_receive() must pass packets on to mxt_raw_hid_receive().
+//
+// A field is addressed as type:instance:offset, and its new bytes follow the '=', separated by commas. All the fields
+// given to one set are staged and then committed, adjacent fields in a single write, and if any write fails the driver
+// puts the old values back. T100 cfg1 and tchaux are refused, set the orientation through the driver instead, and
+// choose the auxiliary report data with MXT_CONTACT_ELLIPSE and MXT_CONTACT_PRESSURE.
+// Changes only last until the chip resets unless they are saved to its NV memory. Export prints the running
+// configuration in the .raw format, so it can be compared with tools/mxt_raw_diff or loaded into Microchip's tools.
+//
+//   mxt_tune get 100:0:30 1                              (T100 tchthr)
+//   mxt_tune set 100:0:30=20 100:0:47=8,0 100:0:49=4,0   (tchthr, then the 16 bit movhysti and movhystn)
+//   mxt_tune save
+//   mxt_tune export > tuned.raw
+//
+// Build with: c++ -std=c++17 -O2 -o mxt_tune mxt_tune.cpp $(pkg-config --cflags --libs hidapi-hidraw)
+// Usage: mxt_tune [-d vendor_id:product_id] <get <field> <length>|set <field>=<bytes>...|save|export>
+
+#include <string>
+#include "mxt_raw_hid.h"
+
+static const char *const status_names[] = {"ok", "no such field", "too many fields staged", "bus error",
+                                            "no pool budget for the stage, move some over with mxt_pool"};
+
+static const char *status_name(uint8_t status)
+{
+    return status < sizeof(status_names) / sizeof(*status_names) ? status_names[status] : "unknown error";
+}
+
+// Parse type:instance:offset, and the bytes after an '=' when there are any
+static bool parse_field(const char *text, mxt_raw_hid_field &field)
+{
+    char *end = nullptr;
+    const unsigned long type = strtoul(text, &end, 0);
+    if (*end != ':')
+    {
+        return false;
+    }
+    const unsigned long instance = strtoul(end + 1, &end, 0);
+    if (*end != ':')
+    {
+        return false;
+    }
+    const unsigned long offset = strtoul(end + 1, &end, 0);
+    if (type > 255 || instance > 255 || offset > 255)
+    {
+        return false;
+    }
+    field.type = type;
+    field.instance = instance;
+    field.offset = offset;
+    field.length = 0;
+    if (*end == '=')
+    {
+        do
+        {
+            const unsigned long value = strtoul(end + 1, &end, 0);
+            if (value > 255 || field.length == sizeof(field.data))
+            {
+                return false;
+            }
+            field.data[field.length++] = value;
+        } while (*end == ',');
+    }
+    return *end == '\0';
+}
+
+static bool transfer_field(hid_device *device, mxt_raw_hid_field &field)
+{
+    mxt_raw_hid_field reply = {};
+    if (!raw_hid_transfer(device, (const uint8_t *)&field, (uint8_t *)&reply))
+    {
+        return false;
+    }
+    field = reply;
+    return true;
+}
+
+static int get(hid_device *device, const char *text, const char *length)
+{
+    mxt_raw_hid_field field = {};
+    field.command = MXT_RAW_HID_READ_FIELD;
+    if (!parse_field(text, field) || field.length)
+    {
+        fprintf(stderr, "Bad field %s, expected type:instance:offset\n", text);
+        return 1;
+    }
+    field.length = atoi(length);
+    if (!transfer_field(device, field))
+    {
+        return 1;
+    }
+    if (field.status != MXT_TUNE_OK)
+    {
+        fprintf(stderr, "%s: %s\n", text, status_name(field.status));
+        return 1;
+    }
+    printf("%s =", text);
+    for (int i = 0; i < field.length; i++)
+    {
+        printf(" %u", field.data[i]);
+    }
+    printf("\n");
+    return 0;
+}
+
+static int set(hid_device *device, int count, char **fields)
+{
+    for (int i = 0; i < count; i++)
+    {
+        mxt_raw_hid_field field = {};
+        field.command = MXT_RAW_HID_STAGE_FIELD;
+        if (!parse_field(fields[i], field) || !field.length)
+        {
+            fprintf(stderr, "Bad field %s, expected type:instance:offset=byte[,byte...]\n", fields[i]);
+            field.command = MXT_RAW_HID_DISCARD;
+            transfer_field(device, field);
+            return 1;
+        }
+        if (!transfer_field(device, field) || field.status != MXT_TUNE_OK)
+        {
+            fprintf(stderr, "%s: %s\n", fields[i], status_name(field.status));
+            field.command = MXT_RAW_HID_DISCARD;
+            transfer_field(device, field);
+            return 1;
+        }
+    }
+
+    mxt_raw_hid_field commit = {};
+    commit.command = MXT_RAW_HID_COMMIT;
+    if (!transfer_field(device, commit))
+    {
+        return 1;
+    }
+    if (commit.status != MXT_TUNE_OK)
+    {
+        fprintf(stderr, "Commit failed: %s, nothing was changed\n", status_name(commit.status));
+        return 1;
+    }
+    printf("%d fields written in %u transfers\n", count, commit.length);
+    return 0;
+}
+
+static int save(hid_device *device)
+{
+    mxt_raw_hid_field field = {};
+    field.command = MXT_RAW_HID_BACKUP;
+    if (!transfer_field(device, field))
+    {
+        return 1;
+    }
+    if (field.status != MXT_TUNE_OK)
+    {
+        fprintf(stderr, "Backup failed: %s\n", status_name(field.status));
+        return 1;
+    }
+    return 0;
+}
+
+// The same objects print_configuration() leaves out, they hold no configuration
+static bool object_is_config(uint8_t type)
+{
+    return type != 2 && type != 5 && type != 6 && type != 37 && type != 44;
+}
+
+static int export_raw(hid_device *device)
+{
+    std::vector<uint8_t> info, config;
+    if (!raw_hid_read_block(device, MXT_RAW_HID_READ_INFO, info) || !raw_hid_read_block(device, MXT_RAW_HID_READ_CONFIG, config))
+    {
+        return 1;
+    }
+    if (info.size() < sizeof(mxt_information_block))
+    {
+        fprintf(stderr, "The device hasn't read the chip's information block\n");
+        return 1;
+    }
+    const mxt_information_block &information = *(const mxt_information_block *)info.data();
+    const size_t table_size = information.num_objects * sizeof(mxt_object_table_element);
+    if (info.size() < sizeof(mxt_information_block) + table_size + 3)
+    {
+        fprintf(stderr, "Object table is %zu bytes, expected %zu\n", info.size() - sizeof(mxt_information_block), table_size + 3);
+        return 1;
+    }
+    const mxt_object_table_element *objects = (const mxt_object_table_element *)(info.data() + sizeof(mxt_information_block));
+    const uint8_t *info_crc = info.data() + sizeof(mxt_information_block) + table_size;
+
+    size_t expected = 0;
+    for (int i = 0; i < information.num_objects; i++)
+    {
+        if (object_is_config(objects[i].type))
+        {
+            expected += (objects[i].size_minus_one + 1) * (objects[i].instances_minus_one + 1);
+        }
+    }
+    if (config.size() != expected)
+    {
+        fprintf(stderr, "Read %zu bytes of configuration, expected %zu\n", config.size(), expected);
+        return 1;
+    }
+
+    printf("OBP_RAW V1\n");
+    printf("%02X %02X %02X %02X %02X %02X %02X\n", information.family_id, information.variant_id, information.version,
+           information.build, information.matrix_x_size, information.matrix_y_size, information.num_objects);
+    printf("%02X%02X%02X\n", info_crc[2], info_crc[1], info_crc[0]);
+    printf("%06lX\n", (unsigned long)mxt_crc24(config.data(), config.size()));
+    size_t offset = 0;
+    for (int i = 0; i < information.num_objects; i++)
+    {
+        if (!object_is_config(objects[i].type))
+        {
+            continue;
+        }
+        for (int instance = 0; instance <= objects[i].instances_minus_one; instance++)
+        {
+            printf("%04X %04X %04X", objects[i].type, instance, objects[i].size_minus_one + 1);
+            for (int j = 0; j <= objects[i].size_minus_one; j++)
+            {
+                printf(" %02X", config[offset++]);
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned short vendor_id = 0, product_id = 0;
+    int arg = 1;
+    if (argc > 2 && std::string(argv[1]) == "-d")
+    {
+        char *end = nullptr;
+        vendor_id = strtoul(argv[2], &end, 16);
+        product_id = *end == ':' ? strtoul(end + 1, nullptr, 16) : 0;
+        arg = 3;
+    }
+    if (arg >= argc)
+    {
+        fprintf(stderr, "Usage: %s [-d vendor_id:product_id] <get <field> <length>|set <field>=<bytes>...|save|export>\n", argv[0]);
+        return 1;
+    }
+    const std::string command = argv[arg];
+    hid_device *device = raw_hid_open(vendor_id, product_id);
+    if (!device)
+    {
+        return 1;
+    }
+
+    int result = 1;
+    if (command == "get" && arg + 2 < argc)
+    {
+        result = get(device, argv[arg + 1], argv[arg + 2]);
+    }
+    else if (command == "set" && arg + 1 < argc)
+    {
+        result = set(device, argc - arg - 1, argv + arg + 1);
+    }
+    else if (command == "save")
+    {
+        result = save(device);
+    }
+    else if (command == "export")
+    {
+        result = export_raw(device);
+    }
+    else
+    {
+        fprintf(stderr, "Unknown command %s\n", command.c_str());
+    }
+    hid_close(device);
+    return result;
+}
@@ -0,0 +1,29 @@
+#!/bin/sh
+# Build the driver's minimal profile (MXT_PROFILE_MINIMAL) with the flags QMK uses for size, and print its report from
+# size_report.sh. This is the baseline to track: save it, then compare the keyboard's own build or a later change
+# against it.
+#
+#   CXX=arm-none-eabi-g++ CXXFLAGS="-mcpu=cortex-m4 -mthumb -include peacock.h" tools/size_minimal.sh > minimal.txt
+#   tools/size_report.sh .build/obj_peacock/maxtouch.o minimal.txt
+#
+# The driver doesn't build on its own, CXXFLAGS must bring in what the keyboard provides (the I2C and timer functions,
+# PACKED and so on) as its build does. Extra arguments go to the compiler, so -DMXT_RAW_HID for example shows what a
+# feature adds to the minimal profile. NM defaults to the nm of the same toolchain as CXX.
+#
+# Before measuring, the minimal profile is built with warnings as errors both on its own and with MXT_RAW_HID, the
+# combination most likely to leave a helper unused when none of the features calling it are enabled.
+# Usage: size_minimal.sh [compiler flags]
+
+CXX=${CXX:-arm-none-eabi-g++}
+NM=${NM:-${CXX%g++}nm}
+DIR=$(dirname "$0")
+
+OBJECT=$(mktemp) || exit 1
+trap 'rm -f "$OBJECT"' EXIT
+for FEATURES in "" -DMXT_RAW_HID; do
+    "$CXX" -std=c++20 -Os -Wall -Wextra -Werror -DMXT_PROFILE_MINIMAL $FEATURES $CXXFLAGS "$@" \
+        -x c++ -c "$DIR/../maxtouch.c" -o "$OBJECT" || exit 1
+done
+"$CXX" -std=c++20 -Os -ffunction-sections -fdata-sections -DMXT_PROFILE_MINIMAL $CXXFLAGS "$@" \
+    -x c++ -c "$DIR/../maxtouch.c" -o "$OBJECT" || exit 1
+NM="$NM" "$DIR/size_report.sh" "$OBJECT"
@@ -0,0 +1,73 @@
+#!/bin/sh
+# Break a build of the driver down by function and table, largest first, with totals for code, constant data,
+# initialised data and zeroed RAM. Give it maxtouch.o from the keyboard's build directory, so only the driver is
+# counted, built with -ffunction-sections -fdata-sections as QMK does. Save a report and pass it as the baseline to
+# see what a change or a feature switch costs, symbol by symbol:
+#
+#   tools/size_report.sh .build/obj_peacock/maxtouch.o > minimal.txt
+#   tools/size_report.sh .build/obj_peacock/maxtouch.o minimal.txt
+#
+# tools/size_minimal.sh builds the minimal profile and makes its report, the baseline to track.
+#
+# Set NM for a cross toolchain, e.g. NM=arm-none-eabi-nm.
+# Usage: size_report.sh <object> [baseline]
+
+NM=${NM:-nm}
+
+if [ $# -lt 1 ] || [ ! -f "$1" ]; then
+    echo "Usage: $0 <object> [baseline]" >&2
+    exit 1
+fi
+
+# One "<size> <kind> <symbol>" line per sized symbol, sizes in decimal
+report() {
+    "$NM" --print-size --size-sort --demangle --radix=d "$1" | awk '
+        NF >= 4 {
+            kind = $3
+            if (kind ~ /[Tt]/) kind = "code"
+            else if (kind ~ /[Rr]/) kind = "const"
+            else if (kind ~ /[Dd]/) kind = "data"
+            else if (kind ~ /[BbCc]/) kind = "bss"
+            else next
+            name = $0
+            sub(/^[^ ]+ +[^ ]+ +[^ ]+ +/, "", name)
+            printf "%d %s %s\n", $2 + 0, kind, name
+        }' | sort -k1,1nr
+}
+
+if [ $# -lt 2 ]; then
+    report "$1" | awk '
+        { printf "%6d %-5s %s\n", $1, $2, substr($0, index($0, $3)); total[$2] += $1 }
+        END { printf "# code %d, const %d, data %d, bss %d\n", total["code"], total["const"], total["data"], total["bss"] }'
+    exit 0
+fi
+
+# Compare against a saved report, printing every symbol whose size changed, appeared or went away
+report "$1" | awk -v baseline="$2" '
+    BEGIN {
+        while ((getline line < baseline) > 0) {
+            if (line ~ /^#/) continue
+            split(line, f, " ")
+            name = line
+            sub(/^ *[0-9]+ +[a-z]+ +/, "", name)
+            old[f[2] " " name] = f[1]
+            old_total[f[2]] += f[1]
+        }
+    }
+    {
+        name = substr($0, index($0, $3))
+        key = $2 " " name
+        new_total[$2] += $1
+        if (!(key in old)) printf "%+6d %-5s %s (new)\n", $1, $2, name
+        else if (old[key] != $1) printf "%+6d %-5s %s\n", $1 - old[key], $2, name
+        delete old[key]
+    }
+    END {
+        for (key in old) {
+            split(key, f, " ")
+            printf "%+6d %-5s %s (gone)\n", -old[key], f[1], substr(key, length(f[1]) + 2)
+        }
+        printf "# code %+d, const %+d, data %+d, bss %+d\n", new_total["code"] - old_total["code"],
+               new_total["const"] - old_total["const"], new_total["data"] - old_total["data"],
+               new_total["bss"] - old_total["bss"]
+    }'